@@ -0,0 +1,129 @@
+// ==================================== [charBuffer.c] =============================
+/*
+*	This library implements a lightweight circular buffer for chars. The main usage is
+*	to handle the chars, which have to be transmitted or were received on a
+*	microcontroller via UART.
+*
+*	Usage:
+*	To use the char-buffer, you have to declare a variable that stores the struct
+*	"cb_charBuffer" as well as a char-array, which will contain the chars. After
+*	calling "cb_initBuffer(...)" with the right parameters, you can use the other
+*	functions.
+*
+*	CAUTION: There is no error handling for errors caused through missing cb_charBuffer
+*				or buffer-array. You have to make sure that the buffer is initialized
+*				correctly.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-05-13
+*
+*/
+
+#include <string.h>
+
+#include "charBuffer.h"
+
+void cb_initBuffer(cb_charBuffer *this, uint8_t *buffer, uint16_t size)
+{
+	this->buffer = buffer;
+	this->mask = size-1;
+	this->head = 0;
+	this->tail = 0;
+}
+
+void cb_clearBuffer(cb_charBuffer *this)
+{
+	this->tail = this->head;
+}
+
+uint8_t cb_hasNext(cb_charBuffer *this)
+{
+	return (this->head-this->tail) & this->mask;
+}
+
+uint8_t cb_getFree(cb_charBuffer *this)
+{
+	return (this->tail-this->head-1) & this->mask;
+}
+
+uint8_t cb_put(cb_charBuffer *this, uint8_t value)
+{
+	uint8_t head = this->head;
+	uint8_t next = (head+1) & this->mask;
+	if(next == this->tail)
+		return 0;
+	this->buffer[head] = value;
+	CB_BARRIER();
+	this->head = next;
+	return 1;
+}
+
+uint8_t cb_putN(cb_charBuffer *this, uint8_t *values, uint8_t amount)
+{
+	uint8_t free = cb_getFree(this);
+	if(amount > free)
+		amount = free;
+
+	// copy up to the end of the array, the rest starts at the beginning
+	uint8_t head = this->head;
+	uint16_t span = this->mask+1-head;
+	if(span > amount)
+		span = amount;
+	memcpy(this->buffer+head, values, span);
+	memcpy(this->buffer, values+span, amount-span);
+	CB_BARRIER();
+	this->head = (head+amount) & this->mask;
+	return amount;
+}
+
+void cb_putString(cb_charBuffer *this, uint8_t *values)
+{
+	cb_putN(this, values, strlen((char *) values));
+}
+
+uint8_t cb_getNext(cb_charBuffer *this)
+{
+	if(this->head != this->tail)
+		return this->buffer[this->tail];
+	return 0;
+}
+
+uint8_t cb_getNextOff(cb_charBuffer *this, uint8_t offset)
+{
+	if(offset >= cb_hasNext(this))
+		return 0;
+	return this->buffer[(this->tail+offset) & this->mask];
+}
+
+void cb_getNextN(cb_charBuffer *this, uint8_t *values, uint8_t amount)
+{
+	uint8_t stored = cb_hasNext(this);
+	if(stored > amount)
+		stored = amount;
+
+	uint8_t tail = this->tail;
+	uint16_t span = this->mask+1-tail;
+	if(span > stored)
+		span = stored;
+	memcpy(values, this->buffer+tail, span);
+	memcpy(values+span, this->buffer, stored-span);
+	memset(values+stored, 0, amount-stored);
+}
+
+void cb_delete(cb_charBuffer *this)
+{
+	if(this->head != this->tail)
+	{
+		CB_BARRIER();
+		this->tail = (this->tail+1) & this->mask;
+	}
+}
+
+void cb_deleteN(cb_charBuffer *this, uint8_t amount)
+{
+	uint8_t stored = cb_hasNext(this);
+	if(amount > stored)
+		amount = stored;
+	CB_BARRIER();
+	this->tail = (this->tail+amount) & this->mask;
+}
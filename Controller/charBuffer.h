@@ -0,0 +1,96 @@
+// ==================================== [charBuffer.h] =============================
+/*
+*	This library implements a lightweight circular buffer for chars. The main usage is
+*	to handle the chars, which have to be transmitted or were received on a
+*	microcontroller via UART.
+*
+*	Usage:
+*	To use the char-buffer, you have to declare a variable that stores the struct
+*	"cb_charBuffer" as well as a char-array, which will contain the chars. After
+*	calling "cb_initBuffer(...)" with the right parameters, you can use the other
+*	functions.
+*
+*	The buffer is meant for one producer and one consumer (e.g. an interrupt and the main
+*	loop). The producer only changes "head" (put-functions), the consumer only changes "tail"
+*	(get- and delete-functions, cb_clearBuffer). Both indices are single bytes, so they can be
+*	used from an interrupt and the main loop without disabling interrupts.
+*
+*	CAUTION: There is no error handling for errors caused through missing cb_charBuffer
+*				or buffer-array. You have to make sure that the buffer is initialized
+*				correctly. The size of the buffer has to be a power of two (max. 256),
+*				one char of it stays unused to distinguish a full from an empty buffer.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-05-13
+*
+*/
+
+#ifndef _CHAR_BUFFER_H_
+#define _CHAR_BUFFER_H_
+
+#include <stdint.h>
+
+// keeps the compiler from moving memory accesses across it, e.g. the access of the chars behind
+// the update of an index
+#define CB_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+// Struct to store the needed data for the buffer
+typedef struct
+{
+	uint8_t *buffer;
+	uint8_t mask; // size - 1
+	volatile uint8_t head; // next index to be written, only changed by the producer
+	volatile uint8_t tail; // next index to be read, only changed by the consumer
+}
+cb_charBuffer;
+
+// Used to initialize the buffer. This function must be called before any other function.
+//	The struct cb_charBuffer und the buffer-array have to be declared by the user.
+//	<size> has to be a power of two up to 256.
+void cb_initBuffer(cb_charBuffer *this, uint8_t *buffer, uint16_t size);
+
+// Deletes all data stored in the buffer (consumer).
+void cb_clearBuffer(cb_charBuffer *this);
+
+// Returns the amount of chars stored in the buffer.
+uint8_t cb_hasNext(cb_charBuffer *this);
+
+// Returns the amount of chars, which can still be inserted.
+uint8_t cb_getFree(cb_charBuffer *this);
+
+// Inserts a char into the buffer.
+//	If the buffer is full, the action will be ignored. Returns 1 if the char was inserted.
+uint8_t cb_put(cb_charBuffer *this, uint8_t value);
+
+// Inserts <amount> chars into the buffer from the given buffer.
+// Chars are only inserted, while the buffer is full. All remaining
+// chars will be ignored. Returns the number of inserted chars.
+uint8_t cb_putN(cb_charBuffer *this, uint8_t *values, uint8_t amount);
+
+// Inserts a string from the given buffer into the buffer.
+// The chars are inserted until the zero-terminator is found or the
+//	buffer is full.
+void cb_putString(cb_charBuffer *this, uint8_t *values);
+
+// Returns the next available char. The char will remain in the buffer.
+// If there is no char, the function will return zero.
+uint8_t cb_getNext(cb_charBuffer *this);
+
+// Returns the next available char with <offset>. The char will remain in the buffer.
+// If there is no char, the function will return zero.
+uint8_t cb_getNextOff(cb_charBuffer *this, uint8_t offset);
+
+// Copies the next <amount> chars from the buffer to the given buffer.
+// If there aren't enough chars in the buffer, the given buffer will be
+//	filled up with zeros.
+void cb_getNextN(cb_charBuffer *this, uint8_t *values, uint8_t amount);
+
+// Deletes the next available char in the buffer.
+// If there is no next char, the action will be ignored.
+void cb_delete(cb_charBuffer *this);
+
+// Deletes the next <amount> chars in the buffer. If there aren't as mouch as <amount> chars,
+//	the buffer will be cleared.
+void cb_deleteN(cb_charBuffer *this, uint8_t amount);
+
+#endif
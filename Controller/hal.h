@@ -0,0 +1,35 @@
+// ==================================== [hal.h] =============================
+/*
+*	Hardware abstraction of the kombiinstrument controller.
+*	The firmware gets all register definitions and avr specific functions through this file.
+*	It is built for the ATmega8 by default. With SIMULATION defined, the registers are replaced by
+*	the simulation in "sim/simulation.h", which runs the firmware on a host computer ("make sim").
+*
+*	For further information, read the "readme.txt" of the kombiinstrument project.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-10-08
+*
+*/
+
+#ifndef _HAL_H_
+#define _HAL_H_
+
+#ifdef SIMULATION
+
+#include "sim/simulation.h"
+
+#else
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+
+// body of loops which wait for an interrupt to change a value, the controller just polls
+#define HAL_WAIT()
+
+#endif
+
+#endif
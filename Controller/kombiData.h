@@ -17,10 +17,27 @@
 #define STATUS_OK '0'
 #define STATUS_UNKNOWN '1'
 #define STATUS_INVALID '2'
+#define STATUS_BUSY '3'
+#define STATUS_EMPTY '4'
+#define STATUS_CRC '5'
 
 #define SEND_STATUS_OK "s0e"
 #define SEND_STATUS_UNKNOWN "s1e"
 #define SEND_STATUS_INVALID "s2e"
+#define SEND_STATUS_BUSY "s3e"
+#define SEND_STATUS_EMPTY "s4e"
+#define SEND_STATUS_CRC "s5e"
+
+// Fields of the commands are parsed by position. Profile, baudrate and the flags of "a", "c" and "x"
+// are ASCII digits ('0', '1'...); the interval of "m", the trigger of "o", offset and length of "x",
+// datasets, patches and the crc of "c" are raw bytes, so they may be 'e' as well.
+
+#define NUM_PROFILES 2 // number of profiles, which can be stored in the controller (one EEPROM slot stays spare)
+
+#define PATCH_SIZE 16 // maximum length of a patch ("x"), the controller keeps it until the terminator arrives
+
+#define NUM_BAUD 5 // number of selectable baudrates, index 0 is the default after reset
+#define BAUD_RATES {19200, 38400, 76800, 250000, 500000}
 
 typedef struct
 {
@@ -49,6 +66,77 @@ typedef struct
 #define NUM_BREAK 10
 #define NUM_DIM 5
 
+#define GAMMA_LINEAR 0 // the pwm follows the duty cycle linearly
+#define GAMMA_22 1 // gamma 2.2
+#define GAMMA_CIE 2 // CIE 1931 lightness, the perceived brightness follows the duty cycle linearly
+#define NUM_GAMMA 3
+
+// frame of the telemetry stream, sent as "v<kombiTelemetry>e" in the interval set with "m<ms>e"
+typedef struct
+{
+	uint32_t time; // timer of the controller in 100us
+	uint16_t newRpm; // last measured rpm
+	uint16_t rpm; // filtered rpm, which selects the effects
+	uint16_t dutyCycles[4]; // red, green, blue, starter in timer1 ticks (2048 = 100%)
+	uint16_t dimValue; // dimming value (Q8.8, 256 = full brightness)
+	uint16_t skipped; // frames skipped since the previous one, because the uart was busy
+	uint16_t rejected; // rejected rpm edges since the start of the controller (wraps around)
+	uint16_t masks; // times a noise storm masked the rpm input since the start (wraps around)
+	uint8_t breakActive; // active breakpoint
+	uint8_t dimActive; // active dimmer, NUM_DIM if there is none
+	uint8_t dimPhase; // phase of the active dimmer
+	uint8_t starter; // 1 if the starter outputs are enabled
+}kombiTelemetry;
+
+#define SCOPE_SIZE 64 // periods of one capture (power of two)
+#define SCOPE_IDLE 0 // no capture armed
+#define SCOPE_ARMED 1 // waiting for the trigger, the ring keeps the latest periods
+#define SCOPE_TRIGGERED 2 // recording the periods after the trigger
+#define SCOPE_DONE 3 // the capture is complete
+#define SCOPE_REJECTED 0x8000 // flag of a period, whose edge was rejected by the glitch gate
+#define SCOPE_PERIOD 0x7FFF // mask of the period, longer ones are limited to it
+
+// capture of the raw rpm periods, sent as "h<kombiScope>e" (only with SCOPE=1)
+typedef struct
+{
+	uint8_t state; // SCOPE_, the periods are only valid with SCOPE_DONE
+	uint8_t count; // valid periods, they are the last ones of the ring (oldest first)
+	uint8_t trigger; // index of the period, which triggered the capture
+	uint8_t unit; // us per tick of the periods (100 with INT0, 2 with ICP1)
+	uint32_t time; // timer of the controller at the trigger in 100us
+	uint16_t periods[SCOPE_SIZE]; // periods since the last accepted rpm signal (SCOPE_PERIOD) and SCOPE_REJECTED
+}kombiScope;
+
+#define NUM_IR 6 // interrupts measured by the statistics
+#define IR_TIMER 0 // time-base (TIMER2 compare)
+#define IR_RPM 1 // rpm signal (INT0 or ICP1)
+#define IR_PWM 2 // pwm edges (TIMER1 compare A)
+#define IR_RX 3 // uart RX complete
+#define IR_TX 4 // uart TX complete
+#define IR_EEPROM 5 // EEPROM ready
+
+typedef struct
+{
+	uint16_t max; // longest run in us
+	uint16_t count; // number of runs, stops at 65535 together with sum
+	uint32_t sum; // us of all counted runs
+}interruptStats;
+
+// statistics of the controller since the last request (only with STATS=1), counters stop at 65535
+typedef struct
+{
+	interruptStats interrupts[NUM_IR];
+	uint32_t time; // duration of the measurement in 100us
+	uint32_t sleep; // us the main loop slept (including the interrupts waking it up)
+	uint16_t loops; // main loop passes in the last complete second
+	uint16_t rxOverrun; // chars lost in the uart (data overrun)
+	uint16_t rxFrame; // chars received with framing error
+	uint16_t rxDropped; // received chars dropped, because the input buffer was full
+	uint16_t samplesDropped; // rpm periods dropped, because the sample ring was full
+	uint16_t txWaits; // answers, which had to wait for the TX queue
+	uint16_t baudResets; // falls back to the default baudrate after a framing error or a missing confirmation
+}kombiStats;
+
 typedef struct
 {
 	breakpoint breakpoints[NUM_BREAK];
@@ -60,7 +148,11 @@ typedef struct
 	uint8_t dimActive;
 	uint8_t dimEnabled;
 	uint8_t breakActive;
-	uint8_t filter;
+	uint8_t filter; // slew rate of the rpm (time per rpm step in 100us, 0 = off)
+	uint8_t filterMedian; // number of rpm values for the median filter (0 = off, max. 5)
+	uint8_t filterEma; // weight 1/2^filterEma of the exponential moving average (0 = off, max. 8)
+	uint8_t gamma; // brightness correction of the LED channels (GAMMA_, invalid values = linear)
+	uint8_t dummy; // needed to avoid padding
 }kombiData;
 
 #endif
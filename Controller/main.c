@@ -5,7 +5,8 @@
 *	the engine is already running.
 *	It is designed to run on an Atmel ATmega8 (L) running @8MHz
 *
-*	Communication via UART (19200 baud/s, 8 data bits, no parity, 1 stop bit)
+*	Communication via UART (19200 baud/s, 8 data bits, no parity, 1 stop bit), faster baudrates
+*	can be negotiated with the "b<n>e" command
 *
 *	For further information, read the "readme.txt" of the kombiinstrument project.
 *
@@ -16,18 +17,18 @@
 
 // ==================================== [includes] =========================================
 
-#include <avr/io.h>
 #include <stdint.h>
-#include <avr/interrupt.h>
+#include <string.h>
 
+#include "hal.h"
 #include "charBuffer.h"
 #include "bitOperation.h"
 #include "kombiData.h"
 
 // ==================================== [pin configuration] ===============================
 
-// PORTB0 (ICP1)		- Unused
-// PORTB1 (OC1A)		- Unused
+// PORTB0 (ICP1)		- RPM signal input (RPM_INPUT_ICP1)
+// PORTB1 (OC1A)		- Unused (timer1 compare A schedules the pwm edges internally)
 // PORTB2 (SS/OC1B)		- Unused
 // PORTB3 (MOSI/OC2)	- ISP
 // PORTB4 (MISO)		- ISP
@@ -45,7 +46,7 @@
 
 // PORTD0 (RXD)			- UART
 // PORTD1 (TXD)			- UART
-// PORTD2 (INT0)		- RPM signal input
+// PORTD2 (INT0)		- RPM signal input (RPM_INPUT_INT0)
 // PORTD3 (INT1)		- Unused
 // PORTD4 (XCK)			- Unused
 // PORTD5 (T1)			- Unused
@@ -57,32 +58,91 @@
 #define DDR_LED_BLU &DDRC,0
 #define DDR_STARTER1 &DDRD,6
 #define DDR_STARTER2 &DDRD,7
-#define LED_RED &PORTC,1
-#define LED_GRE &PORTC,2
-#define LED_BLU &PORTC,0
-#define STARTER1 &PORTD,6
-#define STARTER2 &PORTD,7
+#define LED_PORT PORTC // all LED channels are written with one store
+#define LED_RED (1 << 1)
+#define LED_GRE (1 << 2)
+#define LED_BLU (1 << 0)
+#define LED_MASK (LED_RED | LED_GRE | LED_BLU)
+#define STARTER_PORT PORTD
+#define STARTER_MASK ((1 << 6) | (1 << 7))
 
 // ==================================== [defines] ==========================================
 
+#define RPM_INPUT_INT0 0 // rpm signal on INT0, measured with the 100us time-base
+#define RPM_INPUT_ICP1 1 // rpm signal on ICP1, measured with the input capture of timer1 (1us)
+#ifndef RPM_INPUT
+#define RPM_INPUT RPM_INPUT_INT0
+#endif
+
+#ifndef STATS
+#define STATS 0 // 1: measures the interrupts and the main loop, the statistics are requested with "ie"
+#endif
+#ifndef SCOPE
+#define SCOPE 0 // 1: captures the raw rpm periods around a trigger ("o<n>e", "he")
+#endif
+#if STATS && SCOPE
+#error "STATS and SCOPE don't fit into the RAM together"
+#endif
+
 #define RPM_TO_NUM 300000 // time-base 100us, 2 signals per round, 60s per round -> 300000 cycles between to signals for 1 RPM
+#define RPM_TO_NUM_ICP 30000000UL // time-base 1us, 2 signals per round, 60s per round -> 30000000 cycles between to signals for 1 RPM
 #define MIN_RPM 3000 // factor for the lowest accepted rpm
-#define PWM_PERIOD 100 // period for pwm signals
+#define RPM_LIMIT 15000 // edges faster than this rpm are always rejected
+#define GLITCH_SHIFT 1 // periods shorter than half of the last accepted one are rejected as glitches
+#define GLITCH_RESYNC 8 // after this many glitches in a row the next edge is accepted, the rpm really rose
+#define EDGE_WINDOW 100 // ticks (10ms) in which the rpm edges are counted
+#define EDGE_LIMIT 8 // more edges within one window mask the rpm interrupt (RPM_LIMIT causes 5)
+#define EDGE_HOLD 100 // ticks the rpm interrupt stays masked
+#define EDGE_REJECTED 0 // glitch, the period continues from the last accepted edge
+#define EDGE_ACCEPTED 1 // the period is stored
+#define EDGE_RESTART 2 // first edge after masking, the period starts again
+#if RPM_INPUT == RPM_INPUT_ICP1
+#define MIN_PERIOD (RPM_TO_NUM_ICP / RPM_LIMIT)
+#define GLITCH_PERIOD (MIN_RPM * 100UL) // longer periods (standing engine) don't gate the next edge
+#define RPM_INTERRUPT_OFF() (TIMSK &= ~(1 << TICIE1))
+#define RPM_INTERRUPT_ON() (TIMSK |= (1 << TICIE1))
+#else
+#define MIN_PERIOD (RPM_TO_NUM / RPM_LIMIT)
+#define GLITCH_PERIOD MIN_RPM // longer periods (standing engine) don't gate the next edge
+#define RPM_INTERRUPT_OFF() (GICR &= ~(1 << INT0))
+#define RPM_INTERRUPT_ON() (GICR |= (1 << INT0))
+#endif
+#define RPM_AVERAGE 1 // number of periods which are averaged for one rpm value
+#define NUM_SAMPLES 8 // size of the ring for raw periods (power of two)
+#define SAMPLE_MASK (NUM_SAMPLES - 1)
+#define MAX_MEDIAN 5 // maximum number of rpm values for the median filter
+#define MAX_EMA 8 // maximum shift of the exponential moving average
+#define DUTY_MAX 100 // duty cycles of the dataset are given in percent
+#define PWM_TICKS 2048 // timer1 ticks (1us) per pwm period (488 Hz), each tick is one step of the duty cycle
+#define PWM_MIN_GAP 16 // edges closer than this (timer1 ticks) are merged into one port write
+#define PWM_LEAD 4 // the compare has to be this far ahead of timer1 (ticks), otherwise the edge is set right away
+#define NUM_PWM_EDGES 4 // start of the period plus one edge per LED channel
+#define LINEAR_FACTOR 5243 // (PWM_TICKS << 16) / (DUTY_MAX << VALUE_SHIFT), converts duty cycles to ticks
+#define SCOPE_POST 48 // periods recorded from the trigger on, the rest of the capture shows the periods before
+#define SCOPE_MASK (SCOPE_SIZE - 1)
 #define CHECK_PERIOD 1000 // checking for low rpm, determine running effects...
 
 #define RED 0
 #define GRE 1
 #define BLU 2
 
-#define NUM_BUFFERS 2
+#define RECIP_SHIFT 24 // reciprocal rpm spans of the breakpoint segments are stored as Q8.24
+#define VALUE_SHIFT 8 // calculated duty cycles are stored as Q8.8 until they are written to the buffer
+#define DIM_SHIFT 8 // dimming values are stored as Q8.8
+#define DIM_ONE (1 << DIM_SHIFT) // dimming value for full brightness
+
+#define NUM_BUFFERS 1
 #define INDATA 0
-#define OUTDATA 1
 
-#define IO_BUFFER_SIZE 150
+#define IN_BUFFER_SIZE 32 // power of two, the frame parser decodes the received chars right away
+#define TX_QUEUE_SIZE 8 // power of two, number of blocks waiting to be sent
+#define TX_MASK (TX_QUEUE_SIZE - 1)
+#define STATUS_STRINGS SEND_STATUS_OK SEND_STATUS_UNKNOWN SEND_STATUS_INVALID SEND_STATUS_BUSY \
+	SEND_STATUS_EMPTY SEND_STATUS_CRC // all status answers in the order of their codes
 
-#define NUM_COMMANDS 7
+#define NUM_COMMANDS (14 + STATS + 2 * SCOPE)
 #define COM 0
-#define NUM 1
+#define FRAME 1
 #define COM_S 0 // save the data from the cache to the memory
 #define COM_R 1 // read the data from the memory into the cache
 #define COM_L 2 // load data via UART to the cache
@@ -90,12 +150,72 @@
 #define COM_T 4 // transfer the data stored in the cache to the active data
 #define COM_D 5 // loads some demo data into the cache
 #define COM_A 6 // activate echo for unknown commands
-
-#define NUM_TIMERS 4
-#define T_PWM 0
-#define T_RPM 1
-#define T_DIMMER 2
-#define T_CHECK 3
+#define COM_W 7 // save the data from the cache to the given profile
+#define COM_Q 8 // read the given profile into the cache
+#define COM_P 9 // read the given profile into the cache and transfer it to the active data
+#define COM_C 10 // load data via UART to the cache, secured by a crc
+#define COM_X 11 // patch a part of the cache via UART
+#define COM_B 12 // switch to another baudrate
+#define COM_M 13 // start or stop the telemetry stream
+#define COM_I 14 // get the statistics (only with STATS)
+#define COM_O (14 + STATS) // arm the rpm capture (only with SCOPE)
+#define COM_H (15 + STATS) // get the rpm capture (only with SCOPE)
+
+#define FR_NONE 0 // command and terminator only
+#define FR_PARAMETER 1 // one parameter char (ASCII digit for profile, baudrate and flag, raw byte for "m" and "o")
+#define FR_DATA 2 // the whole dataset
+#define FR_CRC 3 // activate flag, the whole dataset and the crc (high byte first)
+#define FR_PATCH 4 // activate flag, offset, length and the data of the patch
+
+#define PS_COMMAND 0 // waiting for a command char
+#define PS_PARAMETER 1 // parameter char of the command
+#define PS_OFFSET 2 // offset of a patch
+#define PS_LENGTH 3 // length of a patch
+#define PS_DATA 4 // payload, written directly to its destination
+#define PS_CRC_HIGH 5 // high byte of the received crc
+#define PS_CRC_LOW 6 // low byte of the received crc
+#define PS_TERMINATOR 7 // the frame is complete, if the terminator follows
+
+#if STATS
+#define NUM_TIMERS 7
+#else
+#define NUM_TIMERS 6
+#endif
+#define T_RPM 0
+#define T_CHECK 1
+#define T_FILTER 2
+#define T_BAUD 3
+#define T_TELEMETRY 4
+#define T_EDGE 5
+#define T_STATS 6 // only with STATS
+
+#define STATS_PERIOD 10000 // the main loop passes are counted per second
+#if STATS
+#define STATS_BEGIN() uint16_t statsStart = TCNT1 // timer1 counts in us
+#define STATS_END(index) statsInterrupt(index, statsStart)
+#define STATS_COUNT(field) statsCount(&statsBuffers[statsActive].field)
+#else
+#define STATS_BEGIN()
+#define STATS_END(index)
+#define STATS_COUNT(field) do {} while(0)
+#endif
+
+#define BAUD_DEFAULT 0 // index of 19200 baud/s
+#define NO_BAUD 0xFF // no change of the baudrate requested
+#define BAUD_TIMEOUT 10000 // a new baudrate has to be confirmed within 1s
+
+#define NUM_SLOTS 3 // the profiles rotate through the slots to spread the wear, one more than NUM_PROFILES
+#define EEPROM_BYTES 512 // EEPROM of the ATmega8
+#define NO_PROFILE 0xFF // marks a slot without valid data
+#define SLOT_SIZE (sizeof(kombiData) + sizeof(slotHeader)) // the header follows the data, so it is written last
+
+#define EE_IDLE 0 // no EEPROM write running
+#define EE_WRITING 1 // the EEPROM interrupt streams the cache into the EEPROM
+#define EE_DONE 2 // writing finished, the status still has to be sent
+
+#define DIRTY_RPM (1 << 0) // the rpm changed
+#define DIRTY_DIMMER (1 << 1) // the dimming value changed
+#define DIRTY_DATA (1 << 2) // a new dataset got active
 
 #define NUM_DT 4 // DT -> dutycycle
 #define DT_RED 0
@@ -103,27 +223,170 @@
 #define DT_BLU 2
 #define DT_STARTER 3
 
+// ==================================== [types] ==========================================
+
+// pre-compiled segment between two breakpoints, the index equals the corresponding breakActive
+typedef struct
+{
+	uint32_t recip; // (1 << RECIP_SHIFT) / rpm span of the segment, zero if the color is constant
+	uint16_t rpmDown; // below this rpm the previous segment gets active (hysteresis included)
+	uint16_t rpmUp; // above this rpm the next segment gets active (hysteresis included)
+}breakSegment;
+
+// block of memory to be sent by the TX interrupt
+typedef struct
+{
+	uint8_t *data; // next byte to be sent
+	uint16_t length; // remaining bytes
+	uint8_t value; // storage for single chars, which don't stay in memory until they are sent
+}txBlock;
+
+// header of a dataset slot in the EEPROM
+typedef struct
+{
+	uint16_t sequence; // incremented with every save, the newest valid slot of a profile gets loaded
+	uint8_t profile; // profile stored in the slot
+	uint16_t checksum; // inverted sum of sequence, profile and data bytes
+}slotHeader;
+
+// a save never overwrites the only copy of a profile, so there has to be a spare slot
+_Static_assert(NUM_SLOTS > NUM_PROFILES && NUM_SLOTS * SLOT_SIZE <= EEPROM_BYTES, "the slots don't fit the profiles or the EEPROM");
+
 // ==================================== [variables] ==========================================
 
 volatile uint32_t timer; // gets incremented via timer-interrupt
 uint32_t timers[NUM_TIMERS]; // stores the different timer values
-volatile uint16_t newRpm; // stores the new calculated rpm
-volatile uint16_t rpm; // stores the current rpm
-volatile uint16_t filterStep; // used to count the steps for filtering
+uint16_t newRpm; // stores the new calculated rpm
+uint16_t rpm; // stores the current rpm
+volatile uint32_t samples[NUM_SAMPLES]; // raw periods between two rpm signals, written by the rpm interrupt
+volatile uint8_t sampleHead; // next index to be written, only changed by the rpm interrupt
+uint8_t sampleTail; // next index to be read, only changed by the main loop
+uint32_t glitchMin; // shorter periods are rejected, set by the rpm interrupt from the last accepted period
+uint8_t glitchRun; // glitches in a row
+uint32_t edgeWindow; // timer value at the start of the window of the edge-rate limiter
+uint8_t edgeCount; // rpm edges in the current window
+volatile uint8_t edgeMasked; // the limiter masked the rpm interrupt
+uint8_t edgeRestart; // the next edge only starts a new period
+uint8_t edgeStorm; // a noise storm masked the input recently, the samples are discarded and the rpm is held
+uint16_t rpmRejected; // rejected rpm edges (glitches and noise storms), wraps around
+uint16_t rpmMasks; // times the limiter masked the rpm interrupt, wraps around
+uint32_t periodSum; // sum of the periods for averaging
+uint8_t periodCount; // number of periods in periodSum
+#if RPM_INPUT == RPM_INPUT_ICP1
+volatile uint16_t captureHigh; // upper 16 bits of the timer1 value, counted by the overflow interrupt
+uint32_t captureLast; // extended timer1 value of the last rpm signal
+#endif
 
 cb_charBuffer buffers[NUM_BUFFERS]; // buffers for io-communication
-uint8_t ioBuffers[NUM_BUFFERS][IO_BUFFER_SIZE];
+uint8_t inBuffer[IN_BUFFER_SIZE];
+volatile txBlock txQueue[TX_QUEUE_SIZE]; // the TX interrupt sends the blocks directly from memory
+volatile uint8_t txHead; // next block to be queued, only changed by the main loop
+volatile uint8_t txTail; // block being sent, only changed by the TX interrupt
 
-uint8_t commands[NUM_COMMANDS][2]; // stores the implemented commands
+uint8_t commands[NUM_COMMANDS][2]; // stores the implemented commands and their frame types (FR_)
 uint8_t currentCommand; // stores the currently received command
 
-uint8_t dutyCycles[NUM_DT]; // stores the current duty cycles for each channel; gets updated from Buffer with PWM period
-uint8_t dutyCyclesBuffer[NUM_DT]; // stores the new calculated duty cycles; buffering prevents flickering
-
-uint8_t isSending; // indicates if the output buffer is currently being emptied
+// frame parser
+uint8_t parseState; // part of the frame expected next (PS_)
+uint8_t parseStatus; // answer of the frame, the command is only executed with STATUS_OK
+uint8_t parseParameter; // parameter char of the frame
+uint8_t parseOffset; // offset of a patch
+uint8_t *parseData; // destination of the payload, the payload is discarded without destination
+uint16_t parseIndex; // next byte of the payload
+uint16_t parseLength; // length of the payload
+uint16_t parseCrc; // crc over all chars after the command char, including the received crc
+uint8_t parseCache; // the current frame writes into the cache, it gets restored if the frame is rejected
+uint8_t patchData[PATCH_SIZE]; // data of a patch, it is only copied into the cache with a valid frame
+
+uint16_t dutyCycles[NUM_DT]; // stores the current duty cycles (timer1 ticks) for each channel; gets updated from Buffer with PWM period
+uint16_t dutyCyclesBuffer[2][NUM_DT]; // new calculated duty cycles, the main loop writes the set which isn't ready
+volatile uint8_t dutyReady; // set of dutyCyclesBuffer, which is taken over at the start of the next pwm period
+uint8_t dirty; // DIRTY_ flags for the inputs of calculateEffects that changed since the last calculation
+
+// pwm schedule, gets rebuilt by the compare interrupt once per period
+uint8_t pwmPorts[NUM_PWM_EDGES]; // LED port values for each edge
+uint16_t pwmTimes[NUM_PWM_EDGES]; // timer1 ticks from the start of the period to each edge
+uint8_t pwmEdges; // number of edges in the current period
+uint8_t pwmEdge; // next edge to be set
+uint16_t pwmStart; // timer1 value at the start of the current period
+
+volatile uint8_t isSending; // indicates if the TX queue is currently being emptied
+
+const uint8_t baudUbrr[NUM_BAUD] PROGMEM = {51, 25, 12, 3, 1}; // 8 MHz / (8 * baudrate) - 1 (double data rate)
+uint8_t baudRate; // index of the current baudrate
+uint8_t baudNext; // baudrate to be set after the answer is sent, NO_BAUD if there is none
+uint8_t baudPending; // the current baudrate still has to be confirmed
+volatile uint8_t framingError; // set by the RX interrupt, the other side probably uses another baudrate
 
 uint8_t sendAnswer; // if true, unknown commands will be sent back
 
+kombiTelemetry telemetry; // frame of the telemetry stream, only written while the uart is idle
+uint16_t telemetryInterval; // ticks between two frames, 0 if the stream is stopped
+uint16_t telemetrySkipped; // frames skipped since the last sent one
+
+#if SCOPE
+kombiScope scope; // capture of the rpm periods, the ring gets sorted before it is sent
+volatile uint8_t scopeState; // state of the capture (SCOPE_), changed by the rpm interrupt while recording
+uint8_t scopeHead; // next period to be written by the rpm interrupt
+uint8_t scopeRemaining; // periods to be recorded until the capture is done
+uint32_t scopeTrigger; // longest period which triggers the capture, 0 triggers with the next one
+#endif
+
+#if STATS
+kombiStats statsBuffers[2]; // the active one gets filled, the other one is sent without copying
+volatile uint8_t statsActive; // index of the buffer being filled
+uint32_t statsBegin; // timer value at the start of the measurement
+uint16_t statsLoops; // main loop passes in the current second
+#endif
+
+volatile uint8_t eeState; // state of the EEPROM writer (EE_)
+uint8_t eeIndex; // next byte of the slot to be written by the EEPROM interrupt
+uint16_t eeAddress; // start address of the slot being written
+slotHeader eeHeader; // header of the slot being written
+uint8_t eeSlot; // slot being written
+uint8_t slotProfiles[NUM_SLOTS]; // profile stored in each slot, NO_PROFILE if the slot is invalid
+uint16_t slotSequences[NUM_SLOTS]; // sequence of each slot
+uint16_t slotSequence; // sequence of the newest slot
+uint8_t profileActive; // profile used by the commands s and r, the last loaded or saved one
+
+// filter
+uint16_t medianValues[MAX_MEDIAN]; // last rpm values for the median filter
+uint8_t medianIndex; // next index to be written in medianValues
+uint8_t medianCount; // number of valid values in medianValues
+uint32_t emaSum; // sum of the exponential moving average (rpm << filterEma)
+uint16_t filterRpm; // output of median and ema, the rpm slews towards this value
+
+// gamma correction, duty cycle in ticks for each percent, values between get interpolated
+const uint16_t gammaTables[NUM_GAMMA - 1][DUTY_MAX + 1] PROGMEM =
+{
+	{ // GAMMA_22
+		0, 0, 0, 1, 2, 3, 4, 6, 8, 10,
+		13, 16, 19, 23, 27, 32, 36, 42, 47, 53,
+		59, 66, 73, 81, 89, 97, 106, 115, 124, 134,
+		145, 156, 167, 179, 191, 203, 216, 230, 244, 258,
+		273, 288, 304, 320, 336, 354, 371, 389, 407, 426,
+		446, 466, 486, 507, 528, 550, 572, 595, 618, 642,
+		666, 690, 715, 741, 767, 794, 821, 849, 877, 905,
+		934, 964, 994, 1025, 1056, 1088, 1120, 1152, 1186, 1219,
+		1254, 1288, 1323, 1359, 1396, 1432, 1470, 1508, 1546, 1585,
+		1624, 1664, 1705, 1746, 1787, 1829, 1872, 1915, 1959, 2003,
+		2048
+	},
+	{ // GAMMA_CIE
+		0, 2, 5, 7, 9, 11, 14, 16, 18, 21,
+		23, 26, 29, 32, 35, 39, 43, 47, 52, 56,
+		61, 66, 72, 78, 84, 90, 97, 104, 112, 120,
+		128, 136, 145, 154, 164, 174, 184, 195, 207, 218,
+		230, 243, 256, 269, 283, 298, 313, 328, 344, 360,
+		377, 395, 413, 431, 450, 470, 490, 510, 532, 554,
+		576, 599, 623, 647, 672, 697, 723, 750, 778, 806,
+		835, 864, 894, 925, 956, 989, 1022, 1055, 1090, 1125,
+		1161, 1197, 1235, 1273, 1312, 1352, 1392, 1434, 1476, 1519,
+		1563, 1607, 1653, 1699, 1746, 1794, 1843, 1893, 1944, 1995,
+		2048
+	}
+};
+
 // kombiData
 kombiData kdActive, kdCache;
 uint8_t *pkdActive; // for loop-based data transfer
@@ -131,33 +394,93 @@ uint8_t *pkdCache; // for loop-base data transfer
 
 // breakpoint
 uint8_t breakActive; // points to the active breakpoint
-double breakSlopes[3]; // slopes for each color
-double breakOffset[3]; // offsets for each color
-double breakValues[3]; // calculated value for each color
+breakSegment breakSegments[NUM_BREAK]; // gets compiled from kdActive when a dataset is activated
+uint8_t breakCount; // number of breakpoints with ascending rpm, the following ones are ignored
+uint16_t breakValues[3]; // calculated value for each color (Q8.8)
 
 // dimmer
 uint8_t dimActive; // points to the active dimmer
 uint8_t dimEnabled; // shows if any dimmer is active
 uint8_t dimPhase; // current phase of the dimmer
-double dimValue; // shows the current dimming value
+uint16_t dimValue; // shows the current dimming value (Q8.8, DIM_ONE is full brightness)
+uint16_t dimRamp; // steps of the current rise or fall, dimTime * DIM_ONE / dimLength (rounded down)
+uint16_t dimRest; // remainder of dimRamp, dimRamp * dimLength + dimRest = dimTime * DIM_ONE
+uint16_t dimStep; // whole steps of dimRamp per tick in the current phase
+uint16_t dimStepRest; // remainder of dimStep, it carries into dimRamp
+uint16_t dimRise[2]; // step and remainder during rise, pre-calculated when the dimmer gets active
+uint16_t dimFall[2]; // step and remainder during fall
+uint16_t dimTime; // ticks spent in the current phase
+uint16_t dimLength; // ticks of the current phase
+uint32_t dimTick; // timer value of the last dimmer step
+uint16_t dimBounds[2 * NUM_DIM]; // sorted rpm values at which the matching dimmer changes
+uint8_t dimMatches[2 * NUM_DIM + 1]; // first matching dimmer below each bound and above the last one (NUM_DIM = none)
+uint8_t dimBoundCount; // number of valid values in dimBounds
 
 // ==================================== [function declaration] ==========================================
 
 void initialize(void); // setting the timers, uart, etc.
 void createCommands(void); // filling the array of allowed commands
-void handleData(void); // checks the received data for commands and executes them
-uint8_t hasNextCommand(void); // checks for next valid command
-void sendString(char* data); // send a string via uart
-void loadFromMemory(void); // loads the data from the EEPROM into the cache
-void saveToMemory(void); // saves the data from cache to EEPROM
+void handleData(void); // passes the received chars to the frame parser and executes complete commands
+uint8_t parseChar(uint8_t value); // decodes one received char, returns 1 if a valid command is complete
+void startPayload(uint8_t *data, uint16_t length); // the following chars are written to data (discarded if the frame is invalid)
+void restoreCache(void); // replaces a partially received cache with the active data
+void executeCommand(void); // executes the received command
+void sendString(char* data); // send a string via uart, it has to stay in memory until it is sent
+void sendStatus(uint8_t status); // send the given status
+void sendChar(uint8_t value); // send a copy of one char via uart
+void sendData(uint8_t *data, uint16_t length); // queue data to be sent directly from memory, waits while the queue is full
+volatile txBlock *queueBlock(void); // returns the next free block of the TX queue, waits while the queue is full
+void sendBlock(void); // queues the block and starts sending
+static inline void sendNext(void); // writes the next byte of the TX queue into the uart
+void setBaudrate(uint8_t index); // sets the uart to the baudrate of the given index
+void handleBaud(void); // switches the baudrate after answering and falls back to the default without confirmation
+static inline uint8_t checkEdge(uint32_t period); // glitch gate and edge-rate limiter of the rpm interrupt, returns EDGE_
+void handleEdges(void); // releases the rpm interrupt after a noise storm
+static inline void pushSample(uint32_t period); // stores a raw period in the sample ring (called by the rpm interrupt)
+#if SCOPE
+static inline void recordScope(uint32_t period, uint8_t rejected); // records a raw period while the capture is armed or triggered
+void armScope(uint8_t threshold); // starts a new capture, triggered by a period above threshold*100 rpm
+void sendScope(void); // sends the capture, a complete one is sorted with the oldest period first
+void reverseScope(uint8_t first, uint8_t last); // reverses the order of the given periods
+#endif
+void handleSamples(void); // converts the raw periods to the new rpm value
+void resetFilter(uint16_t value); // sets all filter stages to the given rpm
+void filterSample(uint16_t value); // passes a new rpm value through median and ema
+void handleFilter(void); // moves the rpm towards the filtered value with the slew rate
+void scanMemory(void); // checks all slots of the EEPROM and loads the newest one into the cache
+uint8_t loadFromMemory(uint8_t profile); // loads the given profile from the EEPROM into the cache, returns 0 if it isn't stored
+uint8_t readMemory(uint16_t address); // reads one byte from the EEPROM
+uint16_t slotChecksum(slotHeader *header, uint8_t *data); // calculates the checksum of a slot
+uint8_t findSlot(uint8_t profile); // returns the slot of the newest copy of the profile, NUM_SLOTS if there is none
+uint8_t findFreeSlot(void); // returns the slot with the least valuable data
+void saveToMemory(uint8_t profile); // starts saving the data from cache to EEPROM in the background
+void handleMemory(void); // sends the status when the EEPROM writer finished
 void loadFromCache(void); // transfers the data from cache to active
 void loadDemoData(void); // loads some demo data into the cache
 void resetTimer(uint8_t index); // resets the time for the given timer
 uint32_t getTimeDiff(uint8_t index); // returns the stored time for the given timer
 void determineActiveEffects(void); // checks which breakpoint & dimmer should be active
-void calculateBreakpoint(void); // pre-calculates the parameters for the active breakpoint
+uint8_t findBreakpoint(uint16_t value); // binary search for the breakpoint segment of the given rpm
+uint8_t findDimmer(uint16_t value); // binary search for the first dimmer matching the given rpm
+void compileBreakpoints(void); // pre-calculates the segments for all breakpoints of kdActive
+void compileDimmers(void); // sorts the rpm ranges of all dimmers of kdActive
+uint16_t interpolate(uint8_t dutyStart, uint8_t dutyEnd, uint16_t delta, uint32_t recip); // returns the duty cycle inside a segment (Q8.8)
+uint16_t correctDuty(uint16_t value); // converts a duty cycle (Q8.8) to timer1 ticks with the gamma correction
+uint16_t addLimited(uint16_t value, uint16_t offset); // adds without overflow
+uint16_t subLimited(uint16_t value, uint16_t offset); // subtracts without underflow
+void startDimmer(void); // pre-calculates the increments for the active dimmer and starts with PH_HIGH
+void setDimPhase(uint8_t phase); // starts the given phase, phases without length are skipped
+void handleDimmer(void); // steps the dimmer for each elapsed tick
 void calculateEffects(void); // calculates the outcomes of active breakpoint & dimmer
-void handlePWM(void); // switches the output ports on and off
+void schedulePWM(void); // sorts the edges of the next pwm period
+void handleTelemetry(void); // sends a telemetry frame when it is due and the uart is idle
+void sleepIdle(void); // sleeps until the next interrupt if there is nothing left to do
+#if STATS
+static inline void statsInterrupt(uint8_t index, uint16_t start); // adds the run of an interrupt, which started at the given timer1 value
+static inline void statsCount(uint16_t *counter); // increments a counter, it stops at its maximum
+void handleStats(void); // counts the main loop passes per second
+void sendStats(void); // sends the statistics since the last request and starts a new measurement
+#endif
 
 // ==================================== [program start] ==========================================
 
@@ -170,16 +493,39 @@ int main(void)
 	
 	while(1)
 	{
+		handleMemory();
 		handleData();
+		handleBaud();
+		handleEdges();
+		handleSamples();
+#if STATS
+		handleStats();
+#endif
 
 		if(getTimeDiff(T_CHECK) > CHECK_PERIOD)
 		{
-			if(MIN_RPM < getTimeDiff(T_RPM))
+			if(MIN_RPM < getTimeDiff(T_RPM) && newRpm && !edgeStorm) // the last rpm is held during a noise storm
+			{
 				newRpm = 0;
-			determineActiveEffects();
+				resetFilter(0); // the engine stopped, no need to filter
+			}
 			resetTimer(T_CHECK);
 		}
-		calculateEffects();
+		uint16_t lastRpm = rpm;
+		handleFilter();
+		if(rpm != lastRpm) // the effects are selected with every change of the rpm
+		{
+			determineActiveEffects();
+			dirty |= DIRTY_RPM;
+		}
+		handleDimmer();
+		if(dirty) // the duty cycles only change with their inputs
+		{
+			dirty = 0;
+			calculateEffects();
+		}
+		handleTelemetry();
+		sleepIdle();
 	}
 }
 
@@ -196,18 +542,26 @@ void initialize(void)
 	setBit(DDR_STARTER2, 1);
 
 	// timer setup
-	OCR2 = 100; // time-base 100us
+	OCR2 = 99; // time-base 100us, ctc counts from 0 to OCR2
 	setBit(&TCCR2, WGM21, 1); // ctc mode
 	setBit(&TCCR2, WGM20, 0);
 	setBit(&TIMSK, OCIE2, 1); // enable compare match interrupt
 	setBit(&TCCR2, CS22, 0);
 	setBit(&TCCR2, CS21, 1);
 	setBit(&TCCR2, CS20, 0); // divider 8 -> 1 MHz
+
+	// pwm setup, timer1 runs free and compare A is set to the next edge
+	TCCR1A = 0; // normal mode
+	TCCR1B = (1 << CS11); // divider 8 -> 1 MHz
+	pwmStart = TCNT1 + PWM_TICKS;
+	schedulePWM();
+	OCR1A = pwmStart;
+	setBit(&TIMSK, OCIE1A, 1); // enable compare match interrupt
+	set_sleep_mode(SLEEP_MODE_IDLE); // timers and uart keep running while sleeping
 	
 	// uart setup
-	UBRRH = 0;
-	UBRRL = 25; // baudrate 19200
-	setBit(&UCSRA, U2X, 0); // no double data rate
+	setBaudrate(BAUD_DEFAULT);
+	baudNext = NO_BAUD;
 	setBit(&UCSRB, RXCIE, 1); // enable RX complete interrupt
 	setBit(&UCSRB, TXCIE, 1); // enable TX complete interrupt
 	UCSRC = (1 << URSEL) | (1 << UCSZ0) | (1 << UCSZ1); // URSEL needed to write in UCSRC!
@@ -216,21 +570,28 @@ void initialize(void)
 	setBit(&UCSRB, RXEN, 1); // Enable RX
 
 	// rpm-interrupt setup
+#if RPM_INPUT == RPM_INPUT_ICP1
+	setBit(&DDRB, 0, 0); // set capture pin as input
+	setBit(&TCCR1B, ICNC1, 1); // enable noise canceler
+	setBit(&TCCR1B, ICES1, 1); // capture on rising edge
+	setBit(&TIMSK, TICIE1, 1); // enable input capture interrupt
+	setBit(&TIMSK, TOIE1, 1); // enable overflow interrupt to extend timer1 to 32 bits
+#else
 	setBit(&DDRD, 2, 0); // set interrupt pin as input
 	setBit(&MCUCR, ISC00, 1); // interrupt on rising edge
 	setBit(&MCUCR, ISC01, 1);
 	setBit(&GICR, INT0, 1); // enable interrupt on pin INT0
+#endif
 	
 	// init io-buffers
-	cb_initBuffer(&buffers[INDATA], &ioBuffers[INDATA][0], IO_BUFFER_SIZE);
-	cb_initBuffer(&buffers[OUTDATA], &ioBuffers[OUTDATA][0], IO_BUFFER_SIZE);
+	cb_initBuffer(&buffers[INDATA], inBuffer, IN_BUFFER_SIZE);
 
 	// set kombiData-pointers
 	pkdActive = (uint8_t *) &kdActive;
 	pkdCache = (uint8_t *) &kdCache;
 
 	// load the data stored in EEPROM
-	loadFromMemory();
+	scanMemory();
 	loadFromCache();
 	
 	// enable global interrupts
@@ -240,158 +601,755 @@ void initialize(void)
 void createCommands(void)
 {
 	commands[COM_S][COM] = 's';
-	commands[COM_S][NUM] = 2;
+	commands[COM_S][FRAME] = FR_NONE;
 	commands[COM_R][COM] = 'r';
-	commands[COM_R][NUM] = 2;
+	commands[COM_R][FRAME] = FR_NONE;
 	commands[COM_L][COM] = 'l';
-	commands[COM_L][NUM] = sizeof(kombiData)+2;
+	commands[COM_L][FRAME] = FR_DATA;
 	commands[COM_G][COM] = 'g';
-	commands[COM_G][NUM] = 2;
+	commands[COM_G][FRAME] = FR_NONE;
 	commands[COM_T][COM] = 't';
-	commands[COM_T][NUM] = 2;
+	commands[COM_T][FRAME] = FR_NONE;
 	commands[COM_D][COM] = 'd';
-	commands[COM_D][NUM] = 2;
+	commands[COM_D][FRAME] = FR_NONE;
 	commands[COM_A][COM] = 'a';
-	commands[COM_A][NUM] = 3;
+	commands[COM_A][FRAME] = FR_PARAMETER;
+	commands[COM_W][COM] = 'w';
+	commands[COM_W][FRAME] = FR_PARAMETER;
+	commands[COM_Q][COM] = 'q';
+	commands[COM_Q][FRAME] = FR_PARAMETER;
+	commands[COM_P][COM] = 'p';
+	commands[COM_P][FRAME] = FR_PARAMETER;
+	commands[COM_C][COM] = 'c';
+	commands[COM_C][FRAME] = FR_CRC;
+	commands[COM_X][COM] = 'x';
+	commands[COM_X][FRAME] = FR_PATCH;
+	commands[COM_B][COM] = 'b';
+	commands[COM_B][FRAME] = FR_PARAMETER;
+	commands[COM_M][COM] = 'm';
+	commands[COM_M][FRAME] = FR_PARAMETER;
+#if SCOPE
+	commands[COM_O][COM] = 'o';
+	commands[COM_O][FRAME] = FR_PARAMETER;
+	commands[COM_H][COM] = 'h';
+	commands[COM_H][FRAME] = FR_NONE;
+#endif
+#if STATS
+	commands[COM_I][COM] = 'i';
+	commands[COM_I][FRAME] = FR_NONE;
+#endif
 }
 
 void handleData(void)
 {
-	if(hasNextCommand())
+	while(cb_hasNext(&buffers[INDATA]))
 	{
-		if(currentCommand == COM_S) // save data from cache in EEPROM
+		uint8_t value = cb_getNext(&buffers[INDATA]);
+		cb_delete(&buffers[INDATA]);
+		if(parseChar(value))
 		{
-			saveToMemory();
-			sendString(SEND_STATUS_OK);
+			executeCommand();
+			break; // the other tasks get their turn after each command
 		}
-		else if(currentCommand == COM_R) // read data from EEPROM to cache
+	}
+}
+
+uint8_t parseChar(uint8_t value)
+{
+	parseCrc = _crc_xmodem_update(parseCrc, value);
+	if(parseState == PS_COMMAND)
+	{
+		for(currentCommand = 0; currentCommand < NUM_COMMANDS; currentCommand++) // loop through defined commands
+			if(commands[currentCommand][COM] == value)
+				break;
+		if(currentCommand >= NUM_COMMANDS) // received command is not in command-list
 		{
-			loadFromMemory();
-			sendString(SEND_STATUS_OK);
+			sendString(SEND_STATUS_UNKNOWN);
+			if(sendAnswer) // echo the command for debugging
+			{
+				sendString("\r\n");
+				sendChar(value);
+				sendString("\r\n");
+			}
+			return 0;
 		}
-		else if(currentCommand == COM_L) // load data into cache via UART
+		parseStatus = STATUS_OK;
+		if(eeState != EE_IDLE && currentCommand != COM_G && currentCommand != COM_T
+			&& currentCommand != COM_A && currentCommand != COM_M && currentCommand != COM_I
+			&& currentCommand != COM_O && currentCommand != COM_H) // the cache has to stay untouched while writing
+			parseStatus = STATUS_BUSY;
+		parseCrc = 0; // the crc starts after the command char
+		parseState = PS_PARAMETER;
+		if(commands[currentCommand][FRAME] == FR_NONE)
+			parseState = PS_TERMINATOR;
+		else if(commands[currentCommand][FRAME] == FR_DATA)
+			startPayload(pkdCache, sizeof(kombiData));
+	}
+	else if(parseState == PS_PARAMETER)
+	{
+		parseParameter = value;
+		parseState = PS_TERMINATOR;
+		if(commands[currentCommand][FRAME] == FR_CRC)
+			startPayload(pkdCache, sizeof(kombiData));
+		else if(commands[currentCommand][FRAME] == FR_PATCH)
+			parseState = PS_OFFSET;
+	}
+	else if(parseState == PS_OFFSET)
+	{
+		parseOffset = value;
+		parseState = PS_LENGTH;
+	}
+	else if(parseState == PS_LENGTH)
+	{
+		if((!value || value > PATCH_SIZE || parseOffset >= sizeof(kombiData)
+			|| value > sizeof(kombiData) - parseOffset) && parseStatus == STATUS_OK)
+			parseStatus = STATUS_INVALID; // the data of the patch is skipped up to the terminator
+		startPayload(patchData, value);
+	}
+	else if(parseState == PS_DATA)
+	{
+		if(parseData)
+			parseData[parseIndex] = value;
+		parseIndex++;
+		if(parseIndex >= parseLength)
 		{
-			for(uint8_t i=0; i < sizeof(kombiData); i++)
-				pkdCache[i] = cb_getNextOff(&buffers[INDATA], i+1);
-			sendString(SEND_STATUS_OK);
+			parseState = PS_TERMINATOR;
+			if(commands[currentCommand][FRAME] == FR_CRC)
+				parseState = PS_CRC_HIGH;
 		}
-		else if(currentCommand == COM_G) // get data from cache via UART
+	}
+	else if(parseState == PS_CRC_HIGH)
+	{
+		parseState = PS_CRC_LOW;
+	}
+	else if(parseState == PS_CRC_LOW)
+	{
+		// the crc over the received crc is zero if it matches the crc over flag and data
+		if(parseCrc && parseStatus == STATUS_OK)
+			parseStatus = STATUS_CRC;
+		parseState = PS_TERMINATOR;
+	}
+	else // PS_TERMINATOR
+	{
+		parseState = PS_COMMAND;
+		if(value != 'e') // chars are missing or surplus
+			sendString(SEND_STATUS_INVALID);
+		else if(parseStatus != STATUS_OK)
+			sendStatus(parseStatus);
+		else
 		{
-			cb_put(&buffers[OUTDATA], 'd');
-			for(uint8_t i=0; i < sizeof(kombiData); i++)
-				cb_put(&buffers[OUTDATA], pkdCache[i]);
-			sendString("e");
+			parseCache = 0; // the cache holds the complete payload
+			return 1;
 		}
-		else if(currentCommand == COM_T) // transfer data from cache to active
-		{
-			loadFromCache();
+		restoreCache();
+	}
+	return 0;
+}
+
+void startPayload(uint8_t *data, uint16_t length)
+{
+	parseData = data;
+	if(parseStatus != STATUS_OK) // the answer is already known, the cache stays untouched
+		parseData = 0;
+	else if(length && data == pkdCache) // a patch is kept in patchData, the cache stays untouched
+		parseCache = 1;
+	parseIndex = 0;
+	parseLength = length;
+	parseState = PS_DATA;
+	if(!length)
+		parseState = PS_TERMINATOR;
+}
+
+void restoreCache(void)
+{
+	if(!parseCache) // the cache wasn't touched by the rejected frame
+		return;
+	memcpy(pkdCache, &kdActive, sizeof(kombiData));
+	parseCache = 0;
+}
+
+void executeCommand(void)
+{
+	uint8_t profile = parseParameter - '0'; // parameter of the profile commands
+	if(currentCommand == COM_S) // save data from cache in EEPROM, the status is sent when finished
+	{
+		saveToMemory(profileActive);
+	}
+	else if(currentCommand == COM_R) // read data from EEPROM to cache
+	{
+		if(loadFromMemory(profileActive))
 			sendString(SEND_STATUS_OK);
-		}
-		else if(currentCommand == COM_D) // activate demodata
+		else
+			sendString(SEND_STATUS_EMPTY);
+	}
+	else if((currentCommand == COM_W || currentCommand == COM_Q || currentCommand == COM_P)
+		&& profile >= NUM_PROFILES)
+	{
+		sendString(SEND_STATUS_INVALID);
+	}
+	else if(currentCommand == COM_W) // save data from cache to the given profile, the status is sent when finished
+	{
+		saveToMemory(profile);
+	}
+	else if(currentCommand == COM_Q || currentCommand == COM_P) // read the given profile and activate it on request
+	{
+		if(loadFromMemory(profile))
 		{
-			loadDemoData();
+			if(currentCommand == COM_P)
+				loadFromCache();
 			sendString(SEND_STATUS_OK);
 		}
-		else if(currentCommand == COM_A) // activate answers on unknown commands
+		else
+			sendString(SEND_STATUS_EMPTY);
+	}
+	else if(currentCommand == COM_L) // the data was already written to the cache while receiving
+	{
+		sendString(SEND_STATUS_OK);
+	}
+	else if(currentCommand == COM_C || currentCommand == COM_X) // crc and patch are checked while receiving, activate on request
+	{
+		if(currentCommand == COM_X)
+			memcpy(pkdCache + parseOffset, patchData, parseLength);
+		if(parseParameter == '1')
+			loadFromCache();
+		sendString(SEND_STATUS_OK);
+	}
+	else if(currentCommand == COM_G) // get data from cache via UART
+	{
+		sendString("d");
+		sendData(pkdCache, sizeof(kombiData)); // sent directly from the cache
+		sendString("e");
+	}
+	else if(currentCommand == COM_T) // transfer data from cache to active
+	{
+		loadFromCache();
+		sendString(SEND_STATUS_OK);
+	}
+	else if(currentCommand == COM_D) // activate demodata
+	{
+		loadDemoData();
+		sendString(SEND_STATUS_OK);
+	}
+	else if(currentCommand == COM_B) // switch the baudrate, the same command confirms it at the new baudrate
+	{
+		uint8_t index = parseParameter - '0';
+		if(index >= NUM_BAUD)
+			sendString(SEND_STATUS_INVALID);
+		else
 		{
-			if(cb_getNextOff(&buffers[INDATA], 1) == '1')
-				sendAnswer = 1;
+			if(baudPending && index == baudRate)
+				baudPending = 0;
 			else
-				sendAnswer = 0;
+				baudNext = index;
 			sendString(SEND_STATUS_OK);
 		}
-		cb_deleteN(&buffers[INDATA], commands[currentCommand][NUM]); // clear the buffer after input is computed
 	}
+	else if(currentCommand == COM_A) // activate answers on unknown commands
+	{
+		if(parseParameter == '1')
+			sendAnswer = 1;
+		else
+			sendAnswer = 0;
+		sendString(SEND_STATUS_OK);
+	}
+	else if(currentCommand == COM_M) // the parameter is the interval in ms (raw byte), 0 stops the stream
+	{
+		telemetryInterval = parseParameter * 10;
+		telemetrySkipped = 0;
+		resetTimer(T_TELEMETRY); // the status is sent before the first frame
+		sendString(SEND_STATUS_OK);
+	}
+#if STATS
+	else if(currentCommand == COM_I) // send the statistics
+		sendStats();
+#endif
+#if SCOPE
+	else if(currentCommand == COM_O) // the parameter is the trigger in 100 rpm (raw byte)
+	{
+		armScope(parseParameter);
+		sendString(SEND_STATUS_OK);
+	}
+	else if(currentCommand == COM_H) // send the capture
+		sendScope();
+#endif
 }
 
-uint8_t hasNextCommand(void)
+void sendString(char *data)
+{
+	sendData((uint8_t *) data, strlen(data));
+}
+void sendStatus(uint8_t status)
+{
+	sendData((uint8_t *) STATUS_STRINGS + (status - STATUS_OK) * 3, 3);
+}
+void sendChar(uint8_t value)
+{
+	volatile txBlock *block = queueBlock();
+	block->value = value;
+	block->data = (uint8_t *) &block->value;
+	block->length = 1;
+	sendBlock();
+}
+void sendData(uint8_t *data, uint16_t length)
 {
-	if(cb_hasNext(&buffers[INDATA]))
+	if(!length)
+		return;
+	volatile txBlock *block = queueBlock();
+	block->data = data;
+	block->length = length;
+	sendBlock();
+}
+volatile txBlock *queueBlock(void)
+{
+	if((uint8_t) (txHead - txTail) >= TX_QUEUE_SIZE)
+		STATS_COUNT(txWaits);
+	while((uint8_t) (txHead - txTail) >= TX_QUEUE_SIZE) // the TX interrupt frees the blocks
+		HAL_WAIT();
+	return &txQueue[txHead & TX_MASK];
+}
+void sendBlock(void)
+{
+	txHead++;
+	cli(); // the TX interrupt mustn't change the queue while the first byte is written
+	if(!isSending) // trigger interrupt-based sending
 	{
-		for(currentCommand = 0; currentCommand < NUM_COMMANDS; currentCommand++) // loop through defined commands
-			if(commands[currentCommand][COM] == cb_getNext(&buffers[INDATA]))
-				break;
-		if(currentCommand < NUM_COMMANDS)
+		isSending = 1;
+		sendNext();
+	}
+	sei();
+}
+static inline void sendNext(void)
+{
+	volatile txBlock *block = &txQueue[txTail & TX_MASK];
+	UDR = *block->data++;
+	if(!--block->length)
+		txTail++;
+}
+void setBaudrate(uint8_t index)
+{
+	baudRate = index;
+	UBRRH = 0;
+	UBRRL = pgm_read_byte(&baudUbrr[index]);
+	setBit(&UCSRA, U2X, 1); // double data rate for a lower error at 8 MHz
+	framingError = 0;
+}
+void handleBaud(void)
+{
+	if(baudNext != NO_BAUD && !isSending) // the answer has to be sent completely at the old baudrate
+	{
+		setBaudrate(baudNext);
+		cb_clearBuffer(&buffers[INDATA]); // drop anything received during the switch
+		parseState = PS_COMMAND;
+		restoreCache(); // an interrupted upload is lost
+		baudPending = baudNext != BAUD_DEFAULT;
+		baudNext = NO_BAUD;
+		resetTimer(T_BAUD);
+	}
+	if(baudPending && getTimeDiff(T_BAUD) > BAUD_TIMEOUT)
+	{
+		setBaudrate(BAUD_DEFAULT); // the new baudrate wasn't confirmed
+		baudPending = 0;
+		STATS_COUNT(baudResets);
+	}
+	if(framingError && baudRate != BAUD_DEFAULT) // e.g. a restarted interface talks with 19200 baud/s again
+	{
+		setBaudrate(BAUD_DEFAULT);
+		baudPending = 0;
+		STATS_COUNT(baudResets);
+	}
+	framingError = 0;
+}
+
+static inline uint8_t checkEdge(uint32_t period)
+{
+	uint32_t now = timer;
+	if(now - edgeWindow >= EDGE_WINDOW)
+	{
+		edgeWindow = now;
+		edgeCount = 0;
+	}
+	if(++edgeCount > EDGE_LIMIT) // noise storm, the interrupt stays masked until handleEdges releases it
+	{
+		RPM_INTERRUPT_OFF();
+		edgeMasked = 1;
+		resetTimer(T_EDGE);
+		rpmRejected++;
+		rpmMasks++;
+		return EDGE_REJECTED;
+	}
+	if(edgeRestart) // the edges while masked are lost, so the period is unknown, the gate stays armed
+	{
+		edgeRestart = 0;
+		return EDGE_RESTART;
+	}
+	if(period < MIN_PERIOD || (period < glitchMin && glitchRun < GLITCH_RESYNC))
+	{
+		if(glitchRun < GLITCH_RESYNC)
+			glitchRun++;
+		rpmRejected++;
+		return EDGE_REJECTED;
+	}
+	glitchRun = 0;
+	glitchMin = period <= GLITCH_PERIOD ? period >> GLITCH_SHIFT : 0; // a shift is all the interrupt can afford
+	return EDGE_ACCEPTED;
+}
+void handleEdges(void)
+{
+	if(edgeMasked)
+	{
+		edgeStorm = 1;
+		if(getTimeDiff(T_EDGE) >= EDGE_HOLD)
 		{
-			if(cb_hasNext(&buffers[INDATA]) >= commands[currentCommand][NUM]) // check if already enough chars are available
-			{
-				if(cb_getNextOff(&buffers[INDATA], commands[currentCommand][NUM]-1) == 'e') // check if terminator is present
-					return 1;
-				cb_deleteN(&buffers[INDATA], commands[currentCommand][NUM]); // otherwise delete data from input buffer
-				sendString(SEND_STATUS_INVALID);
-			}
+			// the interrupt is masked, so its variables can be changed; an edge pending
+			// from the storm fires right away and only restarts the period
+			edgeCount = 0;
+			edgeRestart = 1;
+			edgeMasked = 0;
+			resetTimer(T_EDGE); // the storm is over after one window without masking
+			cli();
+			RPM_INTERRUPT_ON();
+			sei();
 		}
-		else // received command is not in command-list
+	}
+	else if(edgeStorm)
+	{
+		cli(); // the rpm interrupt resets T_EDGE when it masks itself again
+		if(!edgeMasked && getTimeDiff(T_EDGE) >= EDGE_WINDOW)
+			edgeStorm = 0;
+		sei();
+	}
+}
+
+static inline void pushSample(uint32_t period)
+{
+	if((uint8_t) (sampleHead - sampleTail) < NUM_SAMPLES) // if the ring is full, the period gets lost
+	{
+		samples[sampleHead & SAMPLE_MASK] = period;
+		sampleHead++;
+	}
+	else
+		STATS_COUNT(samplesDropped);
+}
+
+#if SCOPE
+static inline void recordScope(uint32_t period, uint8_t rejected)
+{
+	uint8_t state = scopeState;
+	if(state != SCOPE_ARMED && state != SCOPE_TRIGGERED)
+		return;
+	if(state == SCOPE_ARMED && !rejected && (!scopeTrigger || period <= scopeTrigger))
+	{
+		scope.time = timer;
+		scopeRemaining = SCOPE_POST;
+		state = SCOPE_TRIGGERED;
+	}
+#if RPM_INPUT == RPM_INPUT_ICP1
+	period >>= 1; // 2us keep the range of 16 bits with the flag
+#endif
+	scope.periods[scopeHead] = (period > SCOPE_PERIOD ? SCOPE_PERIOD : period) | (rejected ? SCOPE_REJECTED : 0);
+	scopeHead = (scopeHead + 1) & SCOPE_MASK;
+	if(scope.count < SCOPE_SIZE)
+		scope.count++;
+	if(state == SCOPE_TRIGGERED && !--scopeRemaining)
+		state = SCOPE_DONE; // the ring stays unchanged until the next capture is armed
+	scopeState = state;
+}
+void armScope(uint8_t threshold)
+{
+	scopeState = SCOPE_IDLE; // the interrupt ignores the capture while it is prepared
+	scopeHead = 0;
+	scope.count = 0;
+	scope.time = 0;
+#if RPM_INPUT == RPM_INPUT_ICP1
+	scope.unit = 2;
+	scopeTrigger = threshold ? RPM_TO_NUM_ICP / (threshold * 100UL) : 0;
+#else
+	scope.unit = 100;
+	scopeTrigger = threshold ? RPM_TO_NUM / (threshold * 100UL) : 0;
+#endif
+	scopeState = SCOPE_ARMED;
+}
+void sendScope(void)
+{
+	scope.state = scopeState;
+	if(scope.state == SCOPE_DONE)
+	{
+		if(scopeHead) // rotate the ring, so the oldest period comes first
 		{
-			sendString(SEND_STATUS_UNKNOWN);
-			if(sendAnswer) // echo the command for debugging
-			{
-				sendString("\r\n");
-				cb_put(&buffers[OUTDATA], cb_getNext(&buffers[INDATA]));
-				sendString("\r\n");
-			}
-			cb_delete(&buffers[INDATA]);
+			reverseScope(0, scopeHead - 1);
+			reverseScope(scopeHead, SCOPE_SIZE - 1);
+			reverseScope(0, SCOPE_SIZE - 1);
+			scopeHead = 0;
 		}
+		scope.trigger = SCOPE_SIZE - SCOPE_POST;
+	}
+	sendString("h");
+	sendData((uint8_t *) &scope, sizeof(kombiScope));
+	sendString("e");
+}
+void reverseScope(uint8_t first, uint8_t last)
+{
+	while(first < last)
+	{
+		uint16_t cache = scope.periods[first];
+		scope.periods[first++] = scope.periods[last];
+		scope.periods[last--] = cache;
 	}
-	return 0;
 }
+#endif
 
-void sendString(char *data)
+void handleSamples(void)
 {
-	cb_putString(&buffers[OUTDATA], (uint8_t *) data);
-	if(!isSending) // trigger interrupt-based sending
+	if(edgeStorm) // the periods of a noise storm are garbage
 	{
-		isSending = 1;
-		UDR = cb_getNext(&buffers[OUTDATA]);
-		cb_delete(&buffers[OUTDATA]);
+		sampleTail = sampleHead;
+		periodSum = 0;
+		periodCount = 0;
+		return;
+	}
+	while(sampleTail != sampleHead)
+	{
+		periodSum += samples[sampleTail & SAMPLE_MASK];
+		sampleTail++;
+		periodCount++;
+		if(periodCount >= RPM_AVERAGE && periodSum > 0) // two signals within one tick can't be converted
+		{
+#if RPM_INPUT == RPM_INPUT_ICP1
+			uint32_t value = RPM_TO_NUM_ICP * periodCount / periodSum;
+#else
+			uint32_t value = (uint32_t) RPM_TO_NUM * periodCount / periodSum;
+#endif
+			if(value > 65535)
+				value = 65535;
+			newRpm = value;
+			filterSample(newRpm);
+			periodSum = 0;
+			periodCount = 0;
+		}
 	}
 }
 
-void loadFromMemory(void)
+void resetFilter(uint16_t value)
 {
-	cli(); // while reading from EEPROM, disable interrupts
-	for(uint8_t i=0; i < sizeof(kombiData); i++)
+	medianCount = 0;
+	medianIndex = 0;
+	emaSum = (uint32_t) value << kdActive.filterEma;
+	filterRpm = value;
+	rpm = value;
+	resetTimer(T_FILTER);
+}
+
+void filterSample(uint16_t value)
+{
+	if(kdActive.filterMedian > 1) // median of the last values rejects single spikes
+	{
+		medianValues[medianIndex] = value;
+		medianIndex++;
+		if(medianIndex >= kdActive.filterMedian)
+			medianIndex = 0;
+		if(medianCount < kdActive.filterMedian)
+			medianCount++;
+
+		uint16_t sorted[MAX_MEDIAN];
+		for(uint8_t i=0; i < medianCount; i++)
+		{
+			uint8_t j = i;
+			for(; j > 0 && sorted[j-1] > medianValues[i]; j--)
+				sorted[j] = sorted[j-1];
+			sorted[j] = medianValues[i];
+		}
+		value = sorted[medianCount / 2];
+	}
+
+	if(kdActive.filterEma) // exponential moving average with the weight 1/2^filterEma
+	{
+		emaSum -= emaSum >> kdActive.filterEma;
+		emaSum += value;
+		value = emaSum >> kdActive.filterEma;
+	}
+
+	filterRpm = value;
+}
+
+void handleFilter(void)
+{
+	if(rpm == filterRpm || kdActive.filter == 0) // without slew rate, the rpm follows directly
+	{
+		rpm = filterRpm;
+		resetTimer(T_FILTER);
+		return;
+	}
+
+	// each kdActive.filter ticks the rpm may change by one
+	uint32_t time = getTimeDiff(T_FILTER);
+	if(time < kdActive.filter)
+		return;
+	uint16_t steps = 65535;
+	if(time < 65535)
+		steps = (uint16_t) time / kdActive.filter;
+	timers[T_FILTER] += (uint32_t) steps * kdActive.filter; // keep the remaining time for the next step
+
+	if(filterRpm > rpm)
 	{
-		while(readBit(&EECR, EEWE)); // wait for possible writing to finish
-		EEARL = i; // write target address
-		EEARH = 0;
-		setBit(&EECR, EERE, 1); // enable read operation
-		pkdCache[i] = EEDR; // load target data to cache
-		setBit(&EECR, EERE, 0); // disable read operation
+		if(filterRpm - rpm > steps)
+			rpm += steps;
+		else
+			rpm = filterRpm;
+	}
+	else
+	{
+		if(rpm - filterRpm > steps)
+			rpm -= steps;
+		else
+			rpm = filterRpm;
 	}
-	EECR = 0; // clear any operation bits
-	sei(); // re-enable interrupts
 }
 
-void saveToMemory(void)
+void scanMemory(void)
+{
+	// the EEPROM writer is idle, so reading doesn't interfere with any interrupt
+	uint8_t newest = NUM_SLOTS;
+	for(uint8_t slot=0; slot < NUM_SLOTS; slot++)
+	{
+		uint16_t address = slot * SLOT_SIZE;
+		slotHeader header;
+		for(uint8_t i=0; i < sizeof(slotHeader); i++)
+			((uint8_t *) &header)[i] = readMemory(address + sizeof(kombiData) + i);
+		for(uint8_t i=0; i < sizeof(kombiData); i++)
+			pkdCache[i] = readMemory(address + i);
+		slotProfiles[slot] = NO_PROFILE;
+		if(header.profile >= NUM_PROFILES || slotChecksum(&header, pkdCache) != header.checksum)
+			continue;
+		slotProfiles[slot] = header.profile;
+		slotSequences[slot] = header.sequence;
+		if(newest == NUM_SLOTS || (int16_t) (header.sequence - slotSequence) > 0) // serial number arithmetic handles the overflow
+		{
+			newest = slot;
+			slotSequence = header.sequence;
+		}
+	}
+
+	profileActive = 0;
+	if(newest < NUM_SLOTS)
+		profileActive = slotProfiles[newest];
+	loadFromMemory(profileActive);
+}
+uint8_t loadFromMemory(uint8_t profile)
 {
-	cli(); // while writing, disable interrupts
+	uint8_t slot = findSlot(profile);
+	if(slot == NUM_SLOTS)
+	{
+		for(slot=0; slot < NUM_SLOTS; slot++)
+			if(slotProfiles[slot] != NO_PROFILE)
+				return 0;
+		if(profile != 0)
+			return 0;
+		// no valid slot at all, the dataset was stored without header at address 0 by older versions
+		for(uint8_t i=0; i < sizeof(kombiData); i++)
+			pkdCache[i] = readMemory(i);
+		profileActive = 0;
+		return 1;
+	}
+	uint16_t address = slot * SLOT_SIZE;
+	for(uint8_t i=0; i < sizeof(kombiData); i++)
+		pkdCache[i] = readMemory(address + i);
+	profileActive = profile;
+	return 1;
+}
+uint8_t readMemory(uint16_t address)
+{
+	while(readBit(&EECR, EEWE)) // wait for possible writing to finish
+		HAL_WAIT();
+	EEARL = address; // write target address
+	EEARH = address >> 8;
+	EECR |= (1 << EERE); // the data is available right after the read operation
+	return EEDR;
+}
+uint16_t slotChecksum(slotHeader *header, uint8_t *data)
+{
+	uint16_t sum = header->sequence + header->profile;
 	for(uint8_t i=0; i < sizeof(kombiData); i++)
+		sum += data[i];
+	return ~sum; // an erased or cleared slot doesn't match
+}
+
+uint8_t findSlot(uint8_t profile)
+{
+	uint8_t found = NUM_SLOTS;
+	for(uint8_t slot=0; slot < NUM_SLOTS; slot++)
+		if(slotProfiles[slot] == profile && (found == NUM_SLOTS
+			|| (int16_t) (slotSequences[slot] - slotSequences[found]) > 0))
+			found = slot;
+	return found;
+}
+uint8_t findFreeSlot(void)
+{
+	// invalid slots first, afterwards the oldest outdated copy of any profile; slot 0 is the last
+	// invalid one, while no slot is valid it may still hold the dataset of older versions
+	uint8_t found = NUM_SLOTS;
+	for(uint8_t i=1; i <= NUM_SLOTS; i++)
 	{
-		while(readBit(&EECR, EEWE)); // wait for possible writing to finish
-		EEARL = i; // write target address
-		EEARH = 0;
-		EEDR = pkdCache[i]; // write target data
-		EECR = (1 << EEMWE);
-		// the write enable bit has to be set within 4 cycles after master write enable
-		// setBit(...) is too slow!
-		EECR |= (1 << EEWE);
+		uint8_t slot = i % NUM_SLOTS;
+		if(slotProfiles[slot] == NO_PROFILE)
+			return slot;
+		if(findSlot(slotProfiles[slot]) != slot && (found == NUM_SLOTS
+			|| (int16_t) (slotSequences[slot] - slotSequences[found]) < 0))
+			found = slot;
+	}
+	return found;
+}
+void saveToMemory(uint8_t profile)
+{
+	// the newest copy of every profile is kept, with NUM_SLOTS > NUM_PROFILES there is always an
+	// invalid slot or an outdated copy to be overwritten, so an interrupted save leaves the last copy
+	eeSlot = findFreeSlot();
+	slotProfiles[eeSlot] = NO_PROFILE; // invalid until the header is written
+	eeAddress = eeSlot * SLOT_SIZE;
+	eeHeader.sequence = slotSequence + 1;
+	eeHeader.profile = profile;
+	eeHeader.checksum = slotChecksum(&eeHeader, pkdCache);
+	profileActive = profile;
+	eeIndex = 0;
+	eeState = EE_WRITING;
+	setBit(&EECR, EERIE, 1); // the ready interrupt writes the bytes, it fires as soon as the EEPROM is idle
+}
+void handleMemory(void)
+{
+	if(eeState == EE_DONE)
+	{
+		slotProfiles[eeSlot] = eeHeader.profile;
+		slotSequences[eeSlot] = eeHeader.sequence;
+		slotSequence = eeHeader.sequence;
+		eeState = EE_IDLE;
+		sendString(SEND_STATUS_OK);
 	}
-	while(readBit(&EECR, EEWE)); // wait for possible writing to finish
-	EECR = 0; // clear any operation bits
-	sei(); // re-enable interrupts
 }
 
 void loadFromCache(void)
 {
-	cli();
-	for(uint8_t i=0; i < sizeof(kombiData); i++)
-		pkdActive[i] = pkdCache[i];
+	// the interrupts neither use kdActive nor the compiled tables, the pwm keeps the last duty cycles
+	// until the new ones are calculated, so there is no need to disable them
+	memcpy(pkdActive, pkdCache, sizeof(kombiData));
 	dimActive = kdActive.dimActive;
 	dimEnabled = kdActive.dimEnabled;
+	compileBreakpoints();
+	compileDimmers();
 	breakActive = kdActive.breakActive;
-	calculateBreakpoint();
-	sei();
+	if(breakActive >= breakCount)
+		breakActive = breakCount - 1;
+	if(dimActive > NUM_DIM)
+		dimActive = NUM_DIM;
+	if(kdActive.filterMedian > MAX_MEDIAN) // invalid filter settings (e.g. older datasets) disable the stage
+		kdActive.filterMedian = 0;
+	if(kdActive.filterEma > MAX_EMA)
+		kdActive.filterEma = 0;
+	if(kdActive.gamma >= NUM_GAMMA)
+		kdActive.gamma = GAMMA_LINEAR;
+	resetFilter(rpm);
+	dirty |= DIRTY_DATA;
+	if(dimEnabled)
+		startDimmer();
+	determineActiveEffects();
 }
 
 void loadDemoData(void)
@@ -432,6 +1390,8 @@ void loadDemoData(void)
 	kdCache.dimEnabled = 1;
 
 	kdCache.filter = 1;
+	kdCache.filterMedian = 3;
+	kdCache.filterEma = 2;
 }
 
 void resetTimer(uint8_t index) // resets the time for the given timer
@@ -449,37 +1409,9 @@ uint32_t getTimeDiff(uint8_t index) // returns the stored time for the given tim
 
 void determineActiveEffects(void)
 {
-	if(breakActive > NUM_BREAK)
-		breakActive = NUM_BREAK;
-	if(dimActive > NUM_DIM)
-		dimActive = NUM_DIM;
-	
-	if(breakActive > 0)
-	{
-		uint16_t rpmMin = kdActive.breakpoints[breakActive-1].rpm;
-		if(rpmMin > kdActive.breakHyst) // prevent underflow
-			rpmMin -= kdActive.breakHyst;
-		else
-			rpmMin = 0;
-		if(rpm < rpmMin)
-		{
-			breakActive--;
-			calculateBreakpoint();
-		}
-	}
-	if(breakActive < (NUM_BREAK - 1))
-	{
-		uint16_t rpmMax = kdActive.breakpoints[breakActive].rpm;
-		if(65535 - rpmMax > kdActive.breakHyst)
-			rpmMax += kdActive.breakHyst;
-		else
-			rpmMax = 65535;
-		if(rpm > rpmMax)
-		{
-			breakActive++;
-			calculateBreakpoint();
-		}
-	}
+	// the hysteresis is already included in the compiled segments
+	if(rpm < breakSegments[breakActive].rpmDown || rpm > breakSegments[breakActive].rpmUp)
+		breakActive = findBreakpoint(rpm);
 
 	uint8_t change = 0;
 	if(dimActive >= NUM_DIM)
@@ -487,16 +1419,8 @@ void determineActiveEffects(void)
 	else
 	{
 		uint16_t rpmMin, rpmMax;
-		rpmMin = kdActive.dimmers[dimActive].rpmLow;
-		rpmMax = kdActive.dimmers[dimActive].rpmHigh;
-		if(rpmMin > kdActive.dimHyst)
-			rpmMin -= kdActive.dimHyst;
-		else
-			rpmMin = 0;
-		if(65535 - rpmMax > kdActive.dimHyst)
-			rpmMax += kdActive.dimHyst;
-		else
-			rpmMax = 65535;
+		rpmMin = subLimited(kdActive.dimmers[dimActive].rpmLow, kdActive.dimHyst);
+		rpmMax = addLimited(kdActive.dimmers[dimActive].rpmHigh, kdActive.dimHyst);
 
 		if(rpm < rpmMin || rpm > rpmMax)
 			change = 1;
@@ -504,185 +1428,605 @@ void determineActiveEffects(void)
 
 	if(change)
 	{
-		dimActive = 0;
-		while(dimActive < NUM_DIM)
+		uint8_t next = findDimmer(rpm);
+		if(next != dimActive)
 		{
-			if(rpm >= kdActive.dimmers[dimActive].rpmLow && rpm <= kdActive.dimmers[dimActive].rpmHigh)
-				break;
-			dimActive++;
+			dimActive = next;
+			startDimmer();
 		}
-		dimPhase = PH_HIGH;
-		resetTimer(T_DIMMER);
-		dimEnabled = 1;
-		if(dimActive == NUM_DIM)
-			dimEnabled = 0;
 	}
 }
 
-void calculateBreakpoint(void)
+uint8_t findBreakpoint(uint16_t value)
 {
-	if(breakActive >= NUM_BREAK) // if no breakpoint is set, set LEDs off
-	{
-		breakSlopes[RED] = 0;
-		breakSlopes[GRE] = 0;
-		breakSlopes[BLU] = 0;
-		breakOffset[RED] = 0;
-		breakOffset[GRE] = 0;
-		breakOffset[BLU] = 0;
-	}
-	else if(breakActive == 0 || breakActive == (NUM_BREAK - 1)) // the first breakpoint has no breakpoint before, therefore, no slopes
+	// segment i covers the rpm above breakpoint i-1 up to breakpoint i
+	uint8_t low = 0, high = breakCount - 1;
+	while(low < high)
 	{
-		breakSlopes[RED] = 0;
-		breakSlopes[GRE] = 0;
-		breakSlopes[BLU] = 0;
-		breakOffset[RED] = kdActive.breakpoints[breakActive].dutyRed;
-		breakOffset[GRE] = kdActive.breakpoints[breakActive].dutyGre;
-		breakOffset[BLU] = kdActive.breakpoints[breakActive].dutyBlu;
+		uint8_t middle = (low + high) / 2;
+		if(kdActive.breakpoints[middle].rpm < value)
+			low = middle + 1;
+		else
+			high = middle;
 	}
-	else
+	return low;
+}
+
+uint8_t findDimmer(uint16_t value)
+{
+	// count the bounds which are less or equal to the rpm
+	uint8_t low = 0, high = dimBoundCount;
+	while(low < high)
 	{
-		double cacheA, cacheB;
-		cacheB = kdActive.breakpoints[breakActive].rpm - kdActive.breakpoints[breakActive-1].rpm;
-		cacheA = kdActive.breakpoints[breakActive].dutyRed - kdActive.breakpoints[breakActive-1].dutyRed;
-		breakSlopes[RED] = cacheA / cacheB;
-		cacheA = kdActive.breakpoints[breakActive].dutyGre - kdActive.breakpoints[breakActive-1].dutyGre;
-		breakSlopes[GRE] = cacheA / cacheB;
-		cacheA = kdActive.breakpoints[breakActive].dutyBlu - kdActive.breakpoints[breakActive-1].dutyBlu;
-		breakSlopes[BLU] = cacheA / cacheB;
-		breakOffset[RED] = kdActive.breakpoints[breakActive].dutyRed - kdActive.breakpoints[breakActive].rpm * breakSlopes[RED];
-		breakOffset[GRE] = kdActive.breakpoints[breakActive].dutyGre - kdActive.breakpoints[breakActive].rpm * breakSlopes[GRE];
-		breakOffset[BLU] = kdActive.breakpoints[breakActive].dutyBlu - kdActive.breakpoints[breakActive].rpm * breakSlopes[BLU];
+		uint8_t middle = (low + high) / 2;
+		if(dimBounds[middle] <= value)
+			low = middle + 1;
+		else
+			high = middle;
 	}
+	return dimMatches[low];
 }
 
-void calculateEffects(void)
+void compileBreakpoints(void)
 {
-	//breakpoints
-	for(uint8_t i=0; i < 3; i++)
-		breakValues[i] = rpm * breakSlopes[i] + breakOffset[i];
+	breakCount = 1;
+	while(breakCount < NUM_BREAK && kdActive.breakpoints[breakCount].rpm >= kdActive.breakpoints[breakCount-1].rpm)
+		breakCount++;
 
-	//dimmer
-	if(dimEnabled)
+	for(uint8_t i=0; i < NUM_BREAK; i++)
 	{
-		if(dimPhase == PH_RISE)
+		breakpoint *end = &kdActive.breakpoints[i];
+		breakSegment *segment = &breakSegments[i];
+
+		// limit the duty cycles, so the interpolation can't overflow
+		if(end->dutyRed > DUTY_MAX)
+			end->dutyRed = DUTY_MAX;
+		if(end->dutyGre > DUTY_MAX)
+			end->dutyGre = DUTY_MAX;
+		if(end->dutyBlu > DUTY_MAX)
+			end->dutyBlu = DUTY_MAX;
+
+		segment->recip = 0;
+		segment->rpmDown = 0; // the first breakpoint has no breakpoint before
+		segment->rpmUp = 65535; // the last breakpoint has no breakpoint after
+		if(i > 0)
 		{
-			dimValue = (double) getTimeDiff(T_DIMMER) / (double) kdActive.dimmers[dimActive].tRise;
-			if(getTimeDiff(T_DIMMER) >= kdActive.dimmers[dimActive].tRise)
+			breakpoint *start = end - 1;
+			segment->rpmDown = subLimited(start->rpm, kdActive.breakHyst);
+			// the first breakpoint has a constant color, therefore, no reciprocal
+			// segments without rpm span use the end values, above the last breakpoint delta is limited
+			if(end->rpm > start->rpm)
 			{
-				dimPhase = PH_HIGH;
-				resetTimer(T_DIMMER);
+				uint16_t span = end->rpm - start->rpm;
+				segment->recip = ((1UL << RECIP_SHIFT) + span / 2) / span;
 			}
 		}
-		else if(dimPhase == PH_HIGH)
+		if(i < (breakCount - 1))
+			segment->rpmUp = addLimited(end->rpm, kdActive.breakHyst);
+	}
+}
+
+void compileDimmers(void)
+{
+	// collect the bounds of all valid dimmers in ascending order, each value only once
+	dimBoundCount = 0;
+	for(uint8_t i=0; i < NUM_DIM; i++)
+	{
+		dimmer *current = &kdActive.dimmers[i];
+		if(current->rpmLow > current->rpmHigh)
+			continue;
+		uint16_t bounds[2] = {current->rpmLow, current->rpmHigh + 1}; // ranges include rpmHigh
+		for(uint8_t j=0; j < 2; j++)
 		{
-			dimValue = 1.0;
-			if(getTimeDiff(T_DIMMER) >= kdActive.dimmers[dimActive].tHigh)
-			{
-				dimPhase = PH_FALL;
-				resetTimer(T_DIMMER);
-			}
+			if(j == 1 && current->rpmHigh == 65535) // range reaches the maximum rpm
+				break;
+			uint8_t k = 0;
+			while(k < dimBoundCount && dimBounds[k] < bounds[j])
+				k++;
+			if(k < dimBoundCount && dimBounds[k] == bounds[j]) // each value only once
+				continue;
+			for(uint8_t l = dimBoundCount; l > k; l--)
+				dimBounds[l] = dimBounds[l-1];
+			dimBounds[k] = bounds[j];
+			dimBoundCount++;
 		}
-		else if(dimPhase == PH_FALL)
+	}
+
+	// determine the first matching dimmer for each range between two bounds
+	for(uint8_t i=0; i <= dimBoundCount; i++)
+	{
+		uint16_t value = 0;
+		if(i > 0)
+			value = dimBounds[i-1];
+		dimMatches[i] = 0;
+		while(dimMatches[i] < NUM_DIM)
 		{
-			dimValue = 1.0 - (double) getTimeDiff(T_DIMMER) / (double) kdActive.dimmers[dimActive].tFall;
-			if(dimValue < 0)
-				dimValue = 0;
-			if(getTimeDiff(T_DIMMER) >= kdActive.dimmers[dimActive].tFall)
-			{
-				dimPhase = PH_LOW;
-				resetTimer(T_DIMMER);
-			}
+			if(value >= kdActive.dimmers[dimMatches[i]].rpmLow && value <= kdActive.dimmers[dimMatches[i]].rpmHigh)
+				break;
+			dimMatches[i]++;
 		}
-		else if(dimPhase == PH_LOW)
+	}
+}
+
+uint16_t interpolate(uint8_t dutyStart, uint8_t dutyEnd, uint16_t delta, uint32_t recip)
+{
+	// delta * (dutyEnd - dutyStart) * recip stays below 100 * (1 << RECIP_SHIFT)
+	int32_t value = ((int32_t) delta * ((int16_t) dutyEnd - dutyStart)) * (int32_t) recip;
+	value = ((int32_t) dutyStart << VALUE_SHIFT) + (value >> (RECIP_SHIFT - VALUE_SHIFT));
+	if(value < 0) // rounding of the reciprocal may overshoot slightly
+		value = 0;
+	else if(value > ((int32_t) DUTY_MAX << VALUE_SHIFT))
+		value = (int32_t) DUTY_MAX << VALUE_SHIFT;
+	return value;
+}
+
+uint16_t correctDuty(uint16_t value)
+{
+	if(kdActive.gamma == GAMMA_LINEAR)
+		return ((uint32_t) value * LINEAR_FACTOR) >> 16;
+
+	uint8_t index = value >> VALUE_SHIFT;
+	const uint16_t *table = gammaTables[kdActive.gamma - 1];
+	uint16_t low = pgm_read_word(&table[index]);
+	if(index >= DUTY_MAX)
+		return low;
+	uint16_t high = pgm_read_word(&table[index + 1]);
+	return low + (((high - low) * (value & 0xFF)) >> VALUE_SHIFT); // the steps of the tables stay below 256 ticks
+}
+
+uint16_t addLimited(uint16_t value, uint16_t offset)
+{
+	if(65535 - value > offset)
+		return value + offset;
+	return 65535;
+}
+
+uint16_t subLimited(uint16_t value, uint16_t offset)
+{
+	if(value > offset)
+		return value - offset;
+	return 0;
+}
+
+void startDimmer(void)
+{
+	dimEnabled = 0;
+	if(dimActive >= NUM_DIM)
+		return;
+	dimEnabled = 1;
+
+	// the steps with remainder replace the division in each step, phases without length are skipped
+	dimmer *current = &kdActive.dimmers[dimActive];
+	if(current->tRise)
+	{
+		dimRise[0] = DIM_ONE / current->tRise;
+		dimRise[1] = DIM_ONE % current->tRise;
+	}
+	if(current->tFall)
+	{
+		dimFall[0] = DIM_ONE / current->tFall;
+		dimFall[1] = DIM_ONE % current->tFall;
+	}
+	dimTick = timer;
+	setDimPhase(PH_HIGH);
+	dirty |= DIRTY_DIMMER;
+}
+
+void setDimPhase(uint8_t phase)
+{
+	for(uint8_t i=0; i < 4; i++)
+	{
+		dimPhase = phase;
+		dimTime = 0;
+		dimRamp = 0;
+		dimRest = 0;
+		dimStep = 0;
+		dimStepRest = 0;
+		if(phase == PH_RISE)
 		{
-			dimValue = 0;
-			if(getTimeDiff(T_DIMMER) >= kdActive.dimmers[dimActive].tLow)
-			{
-				dimPhase = PH_RISE;
-				resetTimer(T_DIMMER);
-			}
+			dimStep = dimRise[0];
+			dimStepRest = dimRise[1];
+			dimLength = kdActive.dimmers[dimActive].tRise;
+		}
+		else if(phase == PH_HIGH)
+			dimLength = kdActive.dimmers[dimActive].tHigh;
+		else if(phase == PH_FALL)
+		{
+			dimStep = dimFall[0];
+			dimStepRest = dimFall[1];
+			dimLength = kdActive.dimmers[dimActive].tFall;
+		}
+		else
+			dimLength = kdActive.dimmers[dimActive].tLow;
+		if(dimLength)
+			break;
+		phase = (phase + 1) & PH_LOW; // PH_RISE follows PH_LOW
+	}
+}
+
+void handleDimmer(void)
+{
+	uint32_t now = timer;
+	uint32_t ticks = now - dimTick;
+	dimTick = now;
+	if(!dimEnabled)
+		return;
+	uint16_t lastValue = dimValue;
+
+	while(ticks--)
+	{
+		dimRamp += dimStep;
+		if(dimRest >= dimLength - dimStepRest) // the remainder carries, without overflowing 16 bits
+		{
+			dimRest -= dimLength - dimStepRest;
+			dimRamp++;
 		}
-		
+		else
+			dimRest += dimStepRest;
+		if(++dimTime >= dimLength)
+			setDimPhase((dimPhase + 1) & PH_LOW);
+	}
+
+	if(dimPhase == PH_RISE)
+		dimValue = dimRamp;
+	else if(dimPhase == PH_HIGH)
+		dimValue = DIM_ONE;
+	else if(dimPhase == PH_FALL)
+		dimValue = DIM_ONE - dimRamp;
+	else
+		dimValue = 0;
+	if(dimValue != lastValue)
+		dirty |= DIRTY_DIMMER;
+}
+
+void calculateEffects(void)
+{
+	//breakpoints
+	breakpoint *end = &kdActive.breakpoints[breakActive];
+	uint32_t recip = breakSegments[breakActive].recip;
+	if(recip)
+	{
+		breakpoint *start = end - 1;
+		uint16_t delta = 0; // position inside the active segment, interpolation is limited to the segment
+		if(rpm > start->rpm)
+			delta = rpm - start->rpm;
+		if(delta > end->rpm - start->rpm)
+			delta = end->rpm - start->rpm;
+		breakValues[RED] = interpolate(start->dutyRed, end->dutyRed, delta, recip);
+		breakValues[GRE] = interpolate(start->dutyGre, end->dutyGre, delta, recip);
+		breakValues[BLU] = interpolate(start->dutyBlu, end->dutyBlu, delta, recip);
+	}
+	else
+	{
+		breakValues[RED] = (uint16_t) end->dutyRed << VALUE_SHIFT;
+		breakValues[GRE] = (uint16_t) end->dutyGre << VALUE_SHIFT;
+		breakValues[BLU] = (uint16_t) end->dutyBlu << VALUE_SHIFT;
+	}
+
+	//dimmer
+	if(dimEnabled)
+	{
 		for(uint8_t i=0; i < 3; i++)
-			breakValues[i] = breakValues[i] * dimValue;
+			breakValues[i] = ((uint32_t) breakValues[i] * dimValue) >> DIM_SHIFT;
 	}
 
+	// the set, which isn't ready, is filled completely and activated with one store
+	uint16_t *next = dutyCyclesBuffer[dutyReady ^ 1];
 	for(uint8_t i=0; i < 3; i++)
-		dutyCyclesBuffer[i] = (uint8_t) breakValues[i];
+		next[i] = correctDuty(breakValues[i]);
 
+	next[DT_STARTER] = dutyCyclesBuffer[dutyReady][DT_STARTER]; // hysteresis between on and off
 	if(rpm >= kdActive.rpmStarterOff)
-		dutyCyclesBuffer[DT_STARTER] = 0;
+		next[DT_STARTER] = 0;
 	else if(rpm <= kdActive.rpmStarterOn)
-		dutyCyclesBuffer[DT_STARTER] = PWM_PERIOD;
+		next[DT_STARTER] = PWM_TICKS;
+	CB_BARRIER(); // the set has to be complete before the interrupt may take it over
+	dutyReady ^= 1;
 }
 
-void handlePWM(void)
+void schedulePWM(void)
 {
-	if(getTimeDiff(T_PWM) > PWM_PERIOD)
+	for(uint8_t i=0; i < NUM_DT; i++)
+		dutyCycles[i] = dutyCyclesBuffer[dutyReady][i];
+
+	if(dutyCycles[DT_STARTER] > 0)
+		STARTER_PORT |= STARTER_MASK;
+	else
+		STARTER_PORT &= ~STARTER_MASK;
+
+	// sort the channels by their duty cycle
+	uint8_t channels[3] = {DT_RED, DT_GRE, DT_BLU};
+	for(uint8_t i=1; i < 3; i++)
 	{
-		for(uint8_t i=0; i < NUM_DT; i++)
-			dutyCycles[i] = dutyCyclesBuffer[i];
-		if(dutyCycles[DT_RED] > 0)
-			setBit(LED_RED, 1);
-		if(dutyCycles[DT_GRE] > 0)
-			setBit(LED_GRE, 1);
-		if(dutyCycles[DT_BLU] > 0)
-			setBit(LED_BLU, 1);
-		resetTimer(T_PWM);
+		for(uint8_t j=i; j > 0 && dutyCycles[channels[j-1]] > dutyCycles[channels[j]]; j--)
+		{
+			uint8_t cache = channels[j];
+			channels[j] = channels[j-1];
+			channels[j-1] = cache;
+		}
+	}
 
-		if(dutyCycles[DT_STARTER] > 0)
+	// the period starts with all channels on, which have a duty cycle
+	uint8_t port = LED_PORT & ~LED_MASK;
+	if(dutyCycles[DT_RED] > 0)
+		port |= LED_RED;
+	if(dutyCycles[DT_GRE] > 0)
+		port |= LED_GRE;
+	if(dutyCycles[DT_BLU] > 0)
+		port |= LED_BLU;
+	pwmPorts[0] = port;
+	pwmTimes[0] = 0;
+	pwmEdges = 1;
+
+	// each channel, which isn't always on or off, is switched off at its own edge; edges closer
+	// than PWM_MIN_GAP to the previous one or to the next period are rounded to the nearest
+	// possible time, so the compare interrupt never has to wait
+	for(uint8_t i=0; i < 3; i++)
+	{
+		uint16_t duty = dutyCycles[channels[i]];
+		if(duty == 0 || duty >= PWM_TICKS)
+			continue;
+		uint16_t last = pwmTimes[pwmEdges-1];
+		if(duty < last + PWM_MIN_GAP)
+			duty = duty < last + PWM_MIN_GAP / 2 ? last : last + PWM_MIN_GAP;
+		if(duty > PWM_TICKS - PWM_MIN_GAP)
 		{
-			setBit(STARTER1, 1);
-			setBit(STARTER2, 1);
+			if(duty >= PWM_TICKS - PWM_MIN_GAP / 2) // the channel stays on, like all following ones
+				break;
+			duty = PWM_TICKS - PWM_MIN_GAP;
+			if(duty < last + PWM_MIN_GAP)
+				duty = last;
 		}
+		if(channels[i] == DT_RED)
+			port &= ~LED_RED;
+		else if(channels[i] == DT_GRE)
+			port &= ~LED_GRE;
+		else
+			port &= ~LED_BLU;
+		if(pwmTimes[pwmEdges-1] == duty) // channels with the same duty cycle share an edge
+			pwmPorts[pwmEdges-1] = port;
 		else
 		{
-			setBit(STARTER1, 0);
-			setBit(STARTER2, 0);
+			pwmPorts[pwmEdges] = port;
+			pwmTimes[pwmEdges] = duty;
+			pwmEdges++;
 		}
 	}
-	if(dutyCycles[DT_RED] < PWM_PERIOD && getTimeDiff(T_PWM) >= dutyCycles[DT_RED])
-		setBit(LED_RED, 0);
-	if(dutyCycles[DT_GRE] < PWM_PERIOD && getTimeDiff(T_PWM) >= dutyCycles[DT_GRE])
-		setBit(LED_GRE, 0);
-	if(dutyCycles[DT_BLU] < PWM_PERIOD && getTimeDiff(T_PWM) >= dutyCycles[DT_BLU])
-		setBit(LED_BLU, 0);
+	pwmEdge = 0;
+}
+
+void handleTelemetry(void)
+{
+	if(!telemetryInterval || getTimeDiff(T_TELEMETRY) < telemetryInterval)
+		return;
+	timers[T_TELEMETRY] += telemetryInterval; // a late frame doesn't shift the following ones
+	if(getTimeDiff(T_TELEMETRY) >= telemetryInterval) // more than one frame behind
+		resetTimer(T_TELEMETRY);
+	if(isSending) // the previous frame or an answer is still being sent, the frame is skipped instead of waiting
+	{
+		if(telemetrySkipped != 0xFFFF)
+			telemetrySkipped++;
+		return;
+	}
+	telemetry.time = timer;
+	telemetry.newRpm = newRpm;
+	telemetry.rpm = rpm;
+	cli(); // the pwm interrupt takes over new duty cycles at the start of each period
+	memcpy(telemetry.dutyCycles, dutyCycles, sizeof(telemetry.dutyCycles));
+	telemetry.rejected = rpmRejected;
+	telemetry.masks = rpmMasks;
+	sei();
+	telemetry.dimValue = dimValue;
+	telemetry.skipped = telemetrySkipped;
+	telemetry.breakActive = breakActive;
+	telemetry.dimActive = dimActive;
+	telemetry.dimPhase = dimPhase;
+	telemetry.starter = (STARTER_PORT & STARTER_MASK) != 0;
+	telemetrySkipped = 0;
+	// the queue is empty, so the frame is queued without waiting and stays unchanged until it is sent
+	sendString("v");
+	sendData((uint8_t *) &telemetry, sizeof(kombiTelemetry));
+	sendString("e");
 }
 
+void sleepIdle(void)
+{
+	// interrupts stay disabled between the check and sleep_cpu, sei delays them by one
+	// instruction, so an interrupt after the check still wakes up the controller
+	cli();
+	if(!dirty && sampleTail == sampleHead)
+	{
+		sleep_enable();
+#if STATS
+		uint16_t start = TCNT1; // 16 bit registers of timer1 are only read with disabled interrupts in the main loop
+#endif
+		sei();
+		sleep_cpu();
+		sleep_disable();
+#if STATS
+		cli(); // the interrupt waking up the controller counts as sleep
+		statsBuffers[statsActive].sleep += (uint16_t) (TCNT1 - start);
+#endif
+	}
+	sei();
+}
+
+#if STATS
+static inline void statsInterrupt(uint8_t index, uint16_t start)
+{
+	uint16_t duration = TCNT1 - start;
+	interruptStats *stats = &statsBuffers[statsActive].interrupts[index];
+	if(duration > stats->max)
+		stats->max = duration;
+	if(stats->count != 0xFFFF) // the average stays valid when the count stops
+	{
+		stats->count++;
+		stats->sum += duration;
+	}
+}
+static inline void statsCount(uint16_t *counter)
+{
+	if(*counter != 0xFFFF)
+		(*counter)++;
+}
+void handleStats(void)
+{
+	statsLoops++;
+	if(getTimeDiff(T_STATS) >= STATS_PERIOD)
+	{
+		statsBuffers[statsActive].loops = statsLoops;
+		statsLoops = 0;
+		timers[T_STATS] += STATS_PERIOD;
+	}
+}
+void sendStats(void)
+{
+	// the interrupts continue with the other buffer, so the finished one stays unchanged while it is sent
+	uint8_t finished = statsActive;
+	kombiStats *next = &statsBuffers[finished ^ 1];
+	memset(next, 0, sizeof(kombiStats));
+	next->loops = statsBuffers[finished].loops;
+	statsActive = finished ^ 1;
+	uint32_t now = timer;
+	statsBuffers[finished].time = now - statsBegin;
+	statsBegin = now;
+	sendString("i");
+	sendData((uint8_t *) &statsBuffers[finished], sizeof(kombiStats));
+	sendString("e");
+}
+#endif
+
+#if RPM_INPUT == RPM_INPUT_ICP1
+ISR(TIMER1_CAPT_vect)
+{
+	STATS_BEGIN();
+	uint16_t captureLow = ICR1;
+	uint16_t high = captureHigh;
+	// the overflow may have happened just before the capture without being counted yet
+	if(readBit(&TIFR, TOV1) && captureLow < 0x8000)
+		high++;
+	uint32_t capture = ((uint32_t) high << 16) | captureLow;
+	uint8_t edge = checkEdge(capture - captureLast);
+	if(edge == EDGE_ACCEPTED)
+		pushSample(capture - captureLast);
+#if SCOPE
+	if(edge != EDGE_RESTART)
+		recordScope(capture - captureLast, edge == EDGE_REJECTED);
+#endif
+	if(edge != EDGE_REJECTED)
+	{
+		captureLast = capture;
+		resetTimer(T_RPM);
+	}
+	STATS_END(IR_RPM);
+}
+
+ISR(TIMER1_OVF_vect)
+{
+	captureHigh++;
+}
+#else
 ISR(INT0_vect)
 {
-	newRpm = RPM_TO_NUM/getTimeDiff(T_RPM);
-	resetTimer(T_RPM);
+	STATS_BEGIN();
+	uint32_t period = timer - timers[T_RPM];
+	uint8_t edge = checkEdge(period);
+	if(edge == EDGE_ACCEPTED)
+		pushSample(period);
+#if SCOPE
+	if(edge != EDGE_RESTART)
+		recordScope(period, edge == EDGE_REJECTED);
+#endif
+	if(edge != EDGE_REJECTED)
+		resetTimer(T_RPM);
+	STATS_END(IR_RPM);
+}
+#endif
+
+ISR(EE_RDY_vect)
+{
+	STATS_BEGIN();
+	if(eeIndex < SLOT_SIZE)
+	{
+		uint8_t value;
+		if(eeIndex < sizeof(kombiData))
+			value = pkdCache[eeIndex];
+		else
+			value = ((uint8_t *) &eeHeader)[eeIndex - sizeof(kombiData)];
+		uint16_t address = eeAddress + eeIndex++;
+		EEARL = address; // target address
+		EEARH = address >> 8;
+		EECR |= (1 << EERE);
+		if(EEDR != value) // unchanged bytes are skipped, the interrupt fires again right away
+		{
+			EEDR = value; // write target data
+			// the write enable bit has to be set within 4 cycles after master write enable,
+			// both get compiled to sbi and keep the ready interrupt enabled
+			EECR |= (1 << EEMWE);
+			EECR |= (1 << EEWE);
+		}
+	}
+	else
+	{
+		EECR &= ~(1 << EERIE); // all bytes written
+		eeState = EE_DONE;
+	}
+	STATS_END(IR_EEPROM);
 }
 
 ISR(TIMER2_COMP_vect)
 {
+	STATS_BEGIN();
 	timer++;
-	filterStep++;
-	if(filterStep >= kdActive.filter)
+	STATS_END(IR_TIMER);
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+	STATS_BEGIN();
+	while(1)
 	{
-		if(newRpm > rpm)
-			rpm++;
-		else if(newRpm < rpm)
-			rpm--;
-		filterStep = 0;
+		LED_PORT = pwmPorts[pwmEdge++];
+		if(pwmEdge >= pwmEdges) // last edge of the period, prepare the next one
+		{
+			pwmStart += PWM_TICKS;
+			schedulePWM();
+		}
+		uint16_t next = pwmStart + pwmTimes[pwmEdge];
+		if((int16_t) (next - TCNT1) > PWM_LEAD)
+		{
+			OCR1A = next;
+			break;
+		}
+		// the interrupt came late (the edges are at least PWM_MIN_GAP apart), OCR1A would stay
+		// behind the counter, so the edge is set right away instead of waiting for it
 	}
-	handlePWM();
+	STATS_END(IR_PWM);
 }
 
 ISR(USART_RXC_vect) // RX complete
 {
+	STATS_BEGIN();
+	uint8_t status = UCSRA; // has to be read before UDR
+	if(status & (1 << FE))
+	{
+		framingError = 1;
+		STATS_COUNT(rxFrame);
+	}
+	if(status & (1 << DOR)) // chars got lost in the uart, because the interrupt came too late
+		STATS_COUNT(rxOverrun);
 	uint8_t cache = UDR;
-	cb_put(&buffers[INDATA], cache);
+	if(!cb_put(&buffers[INDATA], cache))
+		STATS_COUNT(rxDropped);
+	STATS_END(IR_RX);
 }
 
 ISR(USART_TXC_vect)
 {
-	if(cb_hasNext(&buffers[OUTDATA]))
-	{
-		UDR = cb_getNext(&buffers[OUTDATA]);
-		cb_delete(&buffers[OUTDATA]);
-	}
+	STATS_BEGIN();
+	if(txTail != txHead)
+		sendNext();
 	else
 		isSending = 0;
+	STATS_END(IR_TX);
 }
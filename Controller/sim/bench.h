@@ -0,0 +1,47 @@
+// ==================================== [bench.h] =============================
+/*
+*	Helpers of the host benchmarks in "sim/" ("make check").
+*
+*	The ATmega8 has no divide instruction, avr-gcc calls __udivmodsi4 of the libgcc for a 32 bit
+*	division, which shifts and subtracts once per bit (32 loop passes, several hundred cycles).
+*	The host divides in hardware, so the benchmarks build the former divisions with the same loop
+*	(benchDivide); otherwise the host would hide what the change saves on the controller. The
+*	times are host times and only the ratio between the variants carries over. The absolute
+*	cycles on the controller are measured with "make STATS=1" and "stats" in the interface, the
+*	simulation doesn't know the run time of the code.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-10-08
+*
+*/
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+#include <time.h>
+
+__attribute__((noinline, unused)) static uint32_t benchDivide(uint32_t dividend, uint32_t divisor) // as __udivmodsi4
+{
+	uint32_t remainder = 0;
+	for(uint8_t i=0; i < 32; i++)
+	{
+		remainder = (remainder << 1) | (dividend >> 31);
+		dividend <<= 1;
+		if(remainder >= divisor)
+		{
+			remainder -= divisor;
+			dividend |= 1;
+		}
+	}
+	return dividend;
+}
+
+static inline double benchNow(void) // monotonic time in ns
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,288 @@
+// ==================================== [bufferCheck.c] =============================
+/*
+*	Compares the throughput of the char-buffer with the former one and checks it with one
+*	producer and one consumer thread ("make check").
+*
+*	Throughput: one thread alternately puts and gets chars, the spans change their length, so the
+*	fill level and the wrap-around move through the whole buffer. Both buffers run the same
+*	sequence once with single chars (put, getNext, delete) and once with spans (putN, getNextN,
+*	deleteN), for the input buffer of the controller (32) and the buffers of the frequency
+*	generator (64). The former buffer (formerBuffer.c, the code before the ring) calculates each
+*	index with a modulo and copies spans char by char. The host divides in hardware, on the ATmega8
+*	each modulo is a call of the 8 bit division of the libgcc, so the difference is larger there.
+*	Threads: a producer and a consumer thread use the new buffer at the same time, a full or empty
+*	buffer yields the thread, so the check also runs on a single core. The former buffer shares its
+*	counter between both sides, it can't be used without disabling the interrupts and isn't run.
+*	Each run compares every char with the running sequence. The program prints the throughput and
+*	returns 1 on a wrong or lost char or if the new buffer isn't faster.
+*	The controller and the frequency generator use identical copies of charBuffer.c/h, "make
+*	check" compares them, so this check covers both.
+*	CB_BARRIER only orders the compiler, which is sufficient on the ATmega8 and on hosts with
+*	ordered stores (x86). On other hosts the thread check may fail without a fault of the buffer.
+*
+*	For further information, read the "readme.txt" of the kombiinstrument project.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-10-08
+*
+*/
+
+#define _POSIX_C_SOURCE 200112L // clock_gettime, pthread
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../charBuffer.h"
+#include "formerBuffer.h"
+#include "bench.h"
+
+#define CHECK_BYTES 16000000UL // chars of each run
+#define MAX_SPAN 13 // longest span of putN and getNextN, not a divisor of the sizes
+
+static const uint16_t sizes[] = {32, 64}; // input buffer of the controller, buffers of the frequency generator
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static cb_charBuffer ring;
+static fb_charBuffer former;
+static uint8_t ringData[64];
+static uint8_t useSpans; // 1: putN and getNextN, 0: single chars
+static volatile unsigned long errors;
+static volatile uint8_t finished; // the producer sent all chars or the consumer stopped after an error
+
+// ==================================== [throughput] ==========================================
+
+static void runRing(uint16_t size)
+{
+	uint8_t values[MAX_SPAN];
+	uint8_t next = 0, expected = 0; // next char of the sequence to be put and to be read
+	uint8_t span = 1;
+	unsigned long sent = 0;
+	cb_initBuffer(&ring, ringData, size);
+	while(sent < CHECK_BYTES)
+	{
+		uint8_t amount = span;
+		if(useSpans)
+		{
+			for(uint8_t i=0; i < amount; i++)
+				values[i] = next + i;
+			amount = cb_putN(&ring, values, amount);
+		}
+		else
+		{
+			for(uint8_t i=0; i < span; i++)
+				if(!cb_put(&ring, next + i))
+				{
+					amount = i;
+					break;
+				}
+		}
+		next += amount;
+		sent += amount;
+
+		amount = cb_hasNext(&ring); // the consumer takes the complementary span
+		if(amount > MAX_SPAN + 1 - span)
+			amount = MAX_SPAN + 1 - span;
+		if(useSpans)
+		{
+			cb_getNextN(&ring, values, amount);
+			for(uint8_t i=0; i < amount; i++)
+				if(values[i] != (uint8_t) (expected + i))
+					errors++;
+			cb_deleteN(&ring, amount);
+		}
+		else
+		{
+			for(uint8_t i=0; i < amount; i++)
+			{
+				if(cb_getNext(&ring) != (uint8_t) (expected + i))
+					errors++;
+				cb_delete(&ring);
+			}
+		}
+		expected += amount;
+		span = span % MAX_SPAN + 1;
+	}
+}
+
+static void runFormer(uint16_t size) // the same sequence with the former buffer
+{
+	uint8_t values[MAX_SPAN];
+	uint8_t next = 0, expected = 0;
+	uint8_t span = 1;
+	unsigned long sent = 0;
+	fb_initBuffer(&former, ringData, size);
+	while(sent < CHECK_BYTES)
+	{
+		uint8_t amount = span;
+		uint8_t free = size - 1 - fb_hasNext(&former); // the former put doesn't report a full buffer
+		if(amount > free)
+			amount = free;
+		if(useSpans)
+		{
+			for(uint8_t i=0; i < amount; i++)
+				values[i] = next + i;
+			fb_putN(&former, values, amount);
+		}
+		else
+		{
+			for(uint8_t i=0; i < amount; i++)
+				fb_put(&former, next + i);
+		}
+		next += amount;
+		sent += amount;
+
+		amount = fb_hasNext(&former);
+		if(amount > MAX_SPAN + 1 - span)
+			amount = MAX_SPAN + 1 - span;
+		if(useSpans)
+		{
+			fb_getNextN(&former, values, amount);
+			for(uint8_t i=0; i < amount; i++)
+				if(values[i] != (uint8_t) (expected + i))
+					errors++;
+			fb_deleteN(&former, amount);
+		}
+		else
+		{
+			for(uint8_t i=0; i < amount; i++)
+			{
+				if(fb_getNext(&former) != (uint8_t) (expected + i))
+					errors++;
+				fb_delete(&former);
+			}
+		}
+		expected += amount;
+		span = span % MAX_SPAN + 1;
+	}
+}
+
+// ==================================== [threads] ==========================================
+
+static void *produce(void *unused)
+{
+	uint8_t values[MAX_SPAN];
+	uint8_t next = 0; // next char of the sequence
+	uint8_t span = 1;
+	unsigned long sent = 0;
+	while(sent < CHECK_BYTES && !finished)
+	{
+		if(useSpans)
+		{
+			for(uint8_t i=0; i < span; i++)
+				values[i] = next + i;
+			uint8_t amount = cb_putN(&ring, values, span);
+			next += amount;
+			sent += amount;
+			if(!amount)
+				sched_yield();
+			span = span % MAX_SPAN + 1;
+		}
+		else if(cb_put(&ring, next))
+		{
+			next++;
+			sent++;
+		}
+		else
+			sched_yield();
+	}
+	finished = 1;
+	return unused;
+}
+
+static void *consume(void *unused)
+{
+	uint8_t values[MAX_SPAN];
+	uint8_t expected = 0; // next char of the sequence
+	uint8_t span = MAX_SPAN;
+	unsigned long received = 0;
+	while(received < CHECK_BYTES && !errors)
+	{
+		uint8_t stored = cb_hasNext(&ring);
+		if(!stored)
+		{
+			if(finished && !cb_hasNext(&ring)) // chars got lost
+			{
+				errors += CHECK_BYTES - received;
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+		if(useSpans)
+		{
+			uint8_t amount = stored < span ? stored : span;
+			cb_getNextN(&ring, values, amount);
+			for(uint8_t i=0; i < amount; i++)
+			{
+				if(values[i] != (uint8_t) (expected + i))
+					errors++;
+			}
+			cb_deleteN(&ring, amount);
+			expected += amount;
+			received += amount;
+			span = span > 1 ? span - 1 : MAX_SPAN;
+		}
+		else
+		{
+			if(cb_getNextOff(&ring, stored - 1) != (uint8_t) (expected + stored - 1))
+				errors++;
+			if(cb_getNext(&ring) != expected)
+				errors++;
+			cb_delete(&ring);
+			expected++;
+			received++;
+		}
+	}
+	finished = 1;
+	return unused;
+}
+
+static void runThreads(uint16_t size)
+{
+	cb_initBuffer(&ring, ringData, size);
+	finished = 0;
+	pthread_t producer, consumer;
+	pthread_create(&consumer, NULL, consume, NULL);
+	pthread_create(&producer, NULL, produce, NULL);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+}
+
+static double measure(void (*run)(uint16_t size), uint16_t size) // MB/s
+{
+	double start = benchNow();
+	run(size);
+	return CHECK_BYTES * 1e3 / (benchNow() - start);
+}
+
+int main(void)
+{
+	uint8_t slower = 0;
+	for(unsigned int s=0; s < NUM_SIZES; s++)
+	{
+		for(useSpans=0; useSpans < 2; useSpans++)
+		{
+			double formerRate = measure(runFormer, sizes[s]);
+			double ringRate = measure(runRing, sizes[s]);
+			double threadRate = measure(runThreads, sizes[s]);
+			printf("size %2u, %s: before %.1f MB/s, after %.1f MB/s (%.1fx), two threads %.1f MB/s\n",
+				sizes[s], useSpans ? "spans       " : "single chars", formerRate, ringRate,
+				ringRate / formerRate, threadRate);
+			if(errors)
+			{
+				printf("Fehler! Der Puffer hat %lu Zeichen verloren oder vertauscht.\n", errors);
+				return 1;
+			}
+			if(ringRate <= formerRate)
+				slower = 1;
+		}
+	}
+	if(slower)
+	{
+		printf("Fehler! Der Puffer ist nicht schneller geworden.\n");
+		return 1;
+	}
+	return 0;
+}
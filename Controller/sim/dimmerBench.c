@@ -0,0 +1,176 @@
+// ==================================== [dimmerBench.c] =============================
+/*
+*	Compares the run time of the dimmer before and after the phase accumulator ("make check").
+*
+*	Before: calculateEffects divided the time in the phase by the rise or fall time on every pass
+*	of the main loop (32 bit division, benchDivide, see bench.h).
+*	After: startDimmer divides once, handleDimmer adds the step and carries the remainder for each
+*	elapsed tick, so it follows the former curve exactly.
+*	The timer advances one tick every BENCH_PASSES passes of the main loop. First both run two
+*	cycles of dimmers with rise and fall times from 1 to 65535 ticks and every dimming value (Q8.8)
+*	is compared, then both run a dimmer with BENCH_PHASE ticks per phase for the time per pass.
+*	The program returns 1 if a value differs or if the phase accumulator isn't faster.
+*
+*	For further information, read the "readme.txt" of the kombiinstrument project.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-10-08
+*
+*/
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../kombiData.h"
+#include "bench.h"
+
+#define BENCH_CYCLES 100 // full dimmer cycles of each variant
+#define BENCH_PHASE 5000 // ticks of each phase
+#define BENCH_PASSES 4 // main loop passes per tick
+#define DIM_SHIFT 8 // as in main.c
+#define DIM_ONE (1 << DIM_SHIFT) // as in main.c
+
+// firmware (main.c, built for the simulation)
+extern volatile uint32_t timer;
+extern kombiData kdActive;
+extern uint8_t dimActive;
+extern uint16_t dimValue;
+void startDimmer(void);
+void handleDimmer(void);
+
+uint8_t formerPhase; // dimPhase of the former dimmer
+uint32_t formerStart; // timer value at the start of the phase (T_DIMMER)
+volatile uint16_t formerValue; // dimValue of the former dimmer
+
+__attribute__((noinline)) static void formerDimmer(void) // dimmer part of calculateEffects before the change
+{
+	uint32_t time = timer - formerStart;
+	dimmer *current = &kdActive.dimmers[dimActive];
+	if(formerPhase == PH_RISE)
+	{
+		if(time >= current->tRise)
+		{
+			formerValue = DIM_ONE;
+			formerPhase = PH_HIGH;
+			formerStart = timer;
+		}
+		else
+			formerValue = benchDivide(time << DIM_SHIFT, current->tRise);
+	}
+	else if(formerPhase == PH_HIGH)
+	{
+		formerValue = DIM_ONE;
+		if(time >= current->tHigh)
+		{
+			formerPhase = PH_FALL;
+			formerStart = timer;
+		}
+	}
+	else if(formerPhase == PH_FALL)
+	{
+		if(time >= current->tFall)
+		{
+			formerValue = 0;
+			formerPhase = PH_LOW;
+			formerStart = timer;
+		}
+		else
+			formerValue = DIM_ONE - benchDivide(time << DIM_SHIFT, current->tFall);
+	}
+	else if(formerPhase == PH_LOW)
+	{
+		formerValue = 0;
+		if(time >= current->tLow)
+		{
+			formerPhase = PH_RISE;
+			formerStart = timer;
+		}
+	}
+}
+
+// rise and fall times of the comparison, around the divisors of DIM_ONE and up to the maximum
+static const uint16_t lengths[] = {1, 2, 3, 7, 100, 255, 256, 257, 1000, 5000, 65535};
+#define NUM_LENGTHS (sizeof(lengths) / sizeof(lengths[0]))
+
+static void setPhases(uint16_t rise, uint16_t high, uint16_t fall, uint16_t low)
+{
+	dimmer *bench = &kdActive.dimmers[0];
+	bench->rpmLow = 0;
+	bench->rpmHigh = 65535;
+	bench->tRise = rise;
+	bench->tHigh = high;
+	bench->tFall = fall;
+	bench->tLow = low;
+	dimActive = 0;
+}
+
+static void startBoth(void)
+{
+	timer = 0;
+	formerPhase = PH_HIGH;
+	formerStart = timer;
+	startDimmer();
+}
+
+int main(void)
+{
+	// the values are compared outside of the measurement, the phases need a length, as the former
+	// dimmer didn't skip empty phases
+	unsigned long compared = 0, differences = 0;
+	for(unsigned int l=0; l < NUM_LENGTHS; l++)
+	{
+		uint16_t rise = lengths[l];
+		uint16_t fall = lengths[(l + 3) % NUM_LENGTHS];
+		setPhases(rise, 2, fall, 1);
+		startBoth();
+		unsigned long passes = 2UL * (rise + fall + 3) * BENCH_PASSES;
+		for(unsigned long i=0; i < passes; i++)
+		{
+			if(i % BENCH_PASSES == 0)
+				timer++;
+			formerDimmer();
+			handleDimmer();
+			if(formerValue != dimValue)
+				differences++;
+			compared++;
+		}
+	}
+
+	setPhases(BENCH_PHASE, BENCH_PHASE, BENCH_PHASE, BENCH_PHASE);
+	unsigned long passes = 4UL * BENCH_PHASE * BENCH_CYCLES * BENCH_PASSES;
+	startBoth();
+	double start = benchNow();
+	for(unsigned long i=0; i < passes; i++)
+	{
+		if(i % BENCH_PASSES == 0)
+			timer++;
+		formerDimmer();
+	}
+	double former = (benchNow() - start) / passes;
+
+	startBoth();
+	start = benchNow();
+	for(unsigned long i=0; i < passes; i++)
+	{
+		if(i % BENCH_PASSES == 0)
+			timer++;
+		handleDimmer();
+	}
+	double current = (benchNow() - start) / passes;
+
+	printf("dimmer before: %.2f ns, after: %.2f ns per pass (%.0f %%), %lu of %lu values differ\n",
+		former, current, 100 * current / former, differences, compared);
+	if(differences)
+	{
+		printf("Fehler! Die Dimmwerte weichen von der frueheren Berechnung ab.\n");
+		return 1;
+	}
+	if(current >= former)
+	{
+		printf("Fehler! Der Dimmer ist nicht schneller geworden.\n");
+		return 1;
+	}
+	return 0;
+}
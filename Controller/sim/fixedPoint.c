@@ -0,0 +1,142 @@
+// ==================================== [fixedPoint.c] =============================
+/*
+*	Compares the fixed point calculation of the breakpoints and the dimmer with the double
+*	calculation of the earlier firmware ("make check").
+*
+*	The firmware interpolates in Q8.8 with a rounded reciprocal of the rpm span and scales the
+*	result with the Q8.8 dimming value. The reference is the former calculation with doubles
+*	(rpm * slope + offset, multiplied with the dimming value), it is compared in two ways:
+*	-Q8.8: the value the firmware uses, against the exact value rounded down to Q8.8
+*	-percent: the integer duty cycle, which the earlier firmware wrote to the pwm
+*	The fixed point values deviate from the exact ones by the truncating shifts (up to 2 steps of
+*	Q8.8) and by the rounded reciprocal, whose error grows with the position in the segment: at
+*	most delta * |dutyEnd - dutyStart| / 2^17 steps, e.g. 50/256 percent at the end of a segment
+*	of 64404 rpm from 0 to 100 percent. As integer duty cycle this is 1 percent at most.
+*	The segments start at rpm values from 0 to 65534, so together with the spans up to 65535 they
+*	cover the whole rpm range. The program prints the maximum deviations and returns 1 if a limit
+*	is exceeded.
+*
+*	For further information, read the "readme.txt" of the kombiinstrument project.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-10-08
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../kombiData.h"
+
+#define LIMIT_Q88 2 // accepted deviation in Q8.8 steps (1/256 percent) by the shifts
+#define RECIP_ERROR 131072 // the reciprocal is rounded to 2^-25, shifted by 2^16 into Q8.8
+#define LIMIT_PERCENT 1 // accepted deviation of the integer duty cycle
+#define NUM_DELTAS 64 // positions checked inside each segment (plus start and end)
+#define DIM_STEP 4 // step of the dimming values between 0 and DIM_ONE
+#define DIM_ONE 256 // full brightness (Q8.8), as in main.c
+#define RED 0 // index of the red value in breakValues, as in main.c
+
+// firmware (main.c, built for the simulation)
+extern kombiData kdActive;
+extern uint16_t rpm;
+extern uint8_t breakActive;
+extern uint16_t breakValues[3];
+extern uint8_t dimEnabled;
+extern uint16_t dimValue;
+void compileBreakpoints(void);
+void calculateEffects(void);
+
+// the small spans have the largest steps, the large ones the largest error of the reciprocal
+static const uint16_t spans[] = {1, 2, 3, 7, 10, 99, 100, 255, 333, 1000, 4096, 12345, 40000, 64404, 64535, 65535};
+#define NUM_SPANS (sizeof(spans) / sizeof(spans[0]))
+
+// rpm of the first breakpoint, segments which don't fit below 65535 rpm are skipped
+static const uint16_t starts[] = {0, 1, 999, 1000, 32768, 65000, 65534};
+#define NUM_STARTS (sizeof(starts) / sizeof(starts[0]))
+
+static unsigned long inputs;
+static int maxQ88, maxPercent;
+static unsigned long overQ88, overPercent;
+
+// exact duty cycle in percent, value of the firmware in Q8.8, accepted deviation by the reciprocal
+static void compare(double exact, uint16_t value, int limit)
+{
+	int deviation = (int) value - (int) floor(exact * 256 + 1e-9);
+	if(abs(deviation) > maxQ88)
+		maxQ88 = abs(deviation);
+	if(abs(deviation) > LIMIT_Q88 + limit)
+		overQ88++;
+
+	deviation = (int) (value >> 8) - (int) (uint8_t) exact; // the old firmware truncated to uint8_t
+	if(abs(deviation) > maxPercent)
+		maxPercent = abs(deviation);
+	if(abs(deviation) > LIMIT_PERCENT)
+		overPercent++;
+	inputs++;
+}
+
+int main(void)
+{
+	for(uint8_t i=0; i < NUM_BREAK; i++) // breakpoint 2 stops the ascending rpm, so segment 1 is the last one
+		kdActive.breakpoints[i].rpm = 0;
+
+	for(unsigned int c=0; c < NUM_STARTS * NUM_SPANS; c++) // each span from each start
+	{
+		uint16_t startRpm = starts[c / NUM_SPANS];
+		uint16_t span = spans[c % NUM_SPANS];
+		if(span > 65535 - startRpm)
+			continue;
+		for(uint8_t dutyStart=0; dutyStart <= 100; dutyStart++)
+		{
+			for(uint8_t dutyEnd=0; dutyEnd <= 100; dutyEnd++)
+			{
+				breakpoint *start = &kdActive.breakpoints[0];
+				breakpoint *end = &kdActive.breakpoints[1];
+				start->rpm = startRpm;
+				start->dutyRed = dutyStart;
+				end->rpm = startRpm + span;
+				end->dutyRed = dutyEnd;
+				compileBreakpoints();
+				breakActive = 1;
+
+				// former calculation (calculateBreakpoint and calculateEffects with doubles)
+				double slope = (double) (dutyEnd - dutyStart) / (double) span;
+				double offset = dutyEnd - (double) end->rpm * slope;
+
+				unsigned int deltas = span < NUM_DELTAS ? span : NUM_DELTAS;
+				for(unsigned int d=0; d <= deltas; d++)
+				{
+					rpm = startRpm + (uint32_t) span * d / deltas;
+					double exact = rpm * slope + offset;
+					int limit = (uint32_t) abs(dutyEnd - dutyStart) * (rpm - startRpm) / RECIP_ERROR;
+
+					dimEnabled = 0;
+					calculateEffects();
+					compare(exact, breakValues[RED], limit);
+
+					if(dutyStart % 10 || dutyEnd % 10) // the dimmer is checked with fewer colors
+						continue;
+					dimEnabled = 1;
+					for(unsigned int dim=0; dim <= DIM_ONE; dim += DIM_STEP)
+					{
+						dimValue = dim;
+						calculateEffects();
+						compare(exact * dim / DIM_ONE, breakValues[RED], limit);
+					}
+				}
+			}
+		}
+	}
+
+	printf("%lu inputs, maximum deviation: %d/256 %%, %d %% as integer duty cycle (limit %d)\n",
+		inputs, maxQ88, maxPercent, LIMIT_PERCENT);
+	if(overQ88 || overPercent)
+	{
+		printf("Fehler! %lu Werte ueber der Grenze (Q8.8), %lu Werte ueber der Grenze (Prozent)\n",
+			overQ88, overPercent);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+// ==================================== [formerBuffer.h] =============================
+/*
+*	The char-buffer of the frequency generator before the lock-free ring, kept as reference for
+*	"sim/bufferCheck.c" ("make check"). The code is unchanged, only the prefix is "fb_" instead of
+*	"cb_", so both buffers can be linked into one program.
+*
+*	This library implements a lightweight circular buffer for chars. The main usage is
+*	to handle the chars, which have to be transmitted or were received on a
+*	microcontroller via UART.
+*
+*	Usage:
+*	To use the char-buffer, you have to declare a variable that stores the struct
+*	"fb_charBuffer" as well as a char-array, which will contain the chars. After
+*	calling "fb_initBuffer(...)" with the right parameters, you can use the other
+*	functions.
+*
+*	CAUTION: There is no error handling for errors caused through missing fb_charBuffer
+*				or buffer-array. You have to make sure that the buffer is initialized
+*				correctly.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-05-13
+*
+*/
+
+#ifndef _FORMER_BUFFER_H_
+#define _FORMER_BUFFER_H_
+
+#include <stdint.h>
+
+// Struct to store the needed data for the buffer
+typedef struct
+{
+	uint8_t *buffer;
+	uint8_t size;
+	uint8_t read;
+	uint8_t write;
+	uint8_t stored;
+}
+fb_charBuffer;
+
+// Used to initialize the buffer. This function must be called before any other function.
+//	The struct fb_charBuffer und the buffer-array have to be declared by the user.
+void fb_initBuffer(fb_charBuffer *this, uint8_t *buffer, uint8_t size);
+
+// Deletes all data stored in the buffer.
+void fb_clearBuffer(fb_charBuffer *this);
+
+// Returns the amount of chars stored in the buffer.
+uint8_t fb_hasNext(fb_charBuffer *this);
+
+// Inserts a char into the buffer.
+//	If the buffer is full, the action will be ignored.
+void fb_put(fb_charBuffer *this, uint8_t value);
+
+// Inserts <amount> chars into the buffer from the given buffer.
+// Chars are only inserted, while the buffer is full. All remaining
+// chars will be ignored.
+void fb_putN(fb_charBuffer *this, uint8_t *values, uint8_t amount);
+
+// Inserts a string from the given buffer into the buffer.
+// The chars are inserted until the zero-terminator is found or the
+//	buffer is full.
+void fb_putString(fb_charBuffer *this, uint8_t *values);
+
+// Returns the next available char. The char will remain in the buffer.
+// If there is no char, the function will return zero.
+uint8_t fb_getNext(fb_charBuffer *this);
+
+// Returns the next available char with <offset>. The char will remain in the buffer.
+// If there is no char, the function will return zero.
+uint8_t fb_getNextOff(fb_charBuffer *this, uint8_t offset);
+
+// Copies the next <amount> chars from the buffer to the given buffer.
+// If there aren't enough chars in the buffer, the given buffer will be
+//	filled up with zeros.
+void fb_getNextN(fb_charBuffer *this, uint8_t *values, uint8_t amount);
+
+// Deletes the next available char in the buffer.
+// If there is no next char, the action will be ignored.
+void fb_delete(fb_charBuffer *this);
+
+// Deletes the next <amount> chars in the buffer. If there aren't as mouch as <amount> chars,
+//	the buffer will be cleared.
+void fb_deleteN(fb_charBuffer *this, uint8_t amount);
+
+#endif
@@ -0,0 +1,80 @@
+// ==================================== [isrBench.c] =============================
+/*
+*	Compares the run time of the rpm interrupt (INT0) before and after the division moved to the
+*	main loop ("make check").
+*
+*	Before: the interrupt divided RPM_TO_NUM by the period and stored newRpm.
+*	After: the interrupt checks the edge (glitch gate and edge-rate limiter) and stores the raw
+*	period in the sample ring, handleSamples divides in the main loop.
+*	The former interrupt divides with benchDivide, the loop of the controller (see bench.h).
+*	Both interrupts run with a pulse train of 3000 rpm, the program prints the time per call and
+*	returns 1 if the new interrupt isn't faster.
+*
+*	For further information, read the "readme.txt" of the kombiinstrument project.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-10-08
+*
+*/
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bench.h"
+
+#define BENCH_CALLS 10000000UL // calls of each variant
+#define BENCH_PERIOD 100 // ticks (100us) between two rpm signals: 3000 rpm
+#define RPM_TO_NUM 300000 // as in main.c
+#define T_RPM 0 // as in main.c
+
+// firmware (main.c, built for the simulation with RPM_INPUT=0)
+extern volatile uint32_t timer;
+extern volatile uint8_t sampleHead;
+extern uint8_t sampleTail;
+void INT0_vect(void);
+void resetTimer(uint8_t index);
+uint32_t getTimeDiff(uint8_t index);
+
+volatile uint16_t formerRpm; // newRpm of the former interrupt
+
+__attribute__((noinline)) static void formerInterrupt(void) // INT0 before the change
+{
+	formerRpm = benchDivide(RPM_TO_NUM, getTimeDiff(T_RPM));
+	resetTimer(T_RPM);
+}
+
+int main(void)
+{
+	double start = benchNow();
+	for(unsigned long i=0; i < BENCH_CALLS; i++)
+	{
+		timer += BENCH_PERIOD;
+		formerInterrupt();
+	}
+	double former = (benchNow() - start) / BENCH_CALLS;
+
+	start = benchNow();
+	for(unsigned long i=0; i < BENCH_CALLS; i++)
+	{
+		timer += BENCH_PERIOD;
+		INT0_vect();
+		sampleTail = sampleHead; // the ring is drained outside of the measurement
+	}
+	double current = (benchNow() - start) / BENCH_CALLS;
+
+	printf("rpm interrupt before: %.2f ns, after: %.2f ns per call (%.0f %%)\n",
+		former, current, 100 * current / former);
+	if(formerRpm != RPM_TO_NUM / BENCH_PERIOD)
+	{
+		printf("Fehler! Die Division ergibt %u statt %u.\n", formerRpm, RPM_TO_NUM / BENCH_PERIOD);
+		return 1;
+	}
+	if(current >= former)
+	{
+		printf("Fehler! Der Interrupt ist nicht schneller geworden.\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/sh
+# ==================================== [rpmCheck.sh] =============================
+#
+#	Checks the rpm measurement of the firmware in the simulation ("make check").
+#
+#	Usage: rpmCheck.sh <kombiSim> <RPM_INPUT>
+#	The simulation generates a clean pulse train for each rpm from 300 to 15000 with the demo
+#	dataset (its slew rate needs 1.5 s up to 15000 rpm). After 3 s the filtered and the last
+#	measured rpm have to match the generated one within one tick of the period: 100us with
+#	INT0 (RPM_INPUT=0), 1us with ICP1 (RPM_INPUT=1), plus 1 rpm for the integer division.
+#	At 15000 rpm this is 750 rpm (5%) with INT0 and 8 rpm with ICP1.
+#	The script prints one line per rpm and returns 1 if any of them is out of the tolerance.
+#
+#	For further information, read the "readme.txt" of the kombiinstrument project.
+#
+#	Author: Tobias Brächter
+#	Last update: 2019-10-08
+#
+
+SIM=$1
+RESOLUTION=100 # us per tick of the period
+if [ "$2" = 1 ]; then
+	RESOLUTION=1
+fi
+
+FAILED=0
+for RPM in 300 500 800 1000 1500 2000 3000 4500 6000 8000 10000 12000 14000 15000
+do
+	$SIM -t 3000 -r $RPM -u 0:de -u 10:te -q | awk -v rpm=$RPM -v resolution=$RESOLUTION '
+		$2 == "rpm:" {
+			found = 1
+			tolerance = rpm * rpm * resolution / 30000000 + 1 # one tick of the period (2 signals per round)
+			result = "ok"
+			if($3 < rpm - tolerance || $3 > rpm + tolerance || $5 < rpm - tolerance || $5 > rpm + tolerance)
+				result = "FEHLER"
+			printf("%5d rpm: gefiltert %5d, gemessen %5d, Toleranz %.0f -> %s\n", rpm, $3, $5, tolerance, result)
+			exit(result != "ok")
+		}
+		END { if(!found) exit(1) }' || FAILED=1
+done
+exit $FAILED
@@ -0,0 +1,631 @@
+// ==================================== [simulation.c] =============================
+/*
+*	Runs the controller firmware on a host computer with a virtual clock ("make sim").
+*
+*	Usage: kombiSim [-t <ms>] [-r [<ms>:]<rpm>] [-n [<ms>:]<rate>] [-u [<ms>:]<text>] [-f [<ms>:]<file>] [-e <file>] [-q]
+*	-t: simulated time in ms (default 1000)
+*	-r: rpm of the generated signal from the given time on (default 0 ms, can be repeated)
+*	-n: additional random edges (noise) per second on the rpm signal from the given time on (can be repeated)
+*	-u: sends the text via UART at the given time (can be repeated)
+*	-f: sends the content of the file via UART at the given time (can be repeated)
+*	-e: EEPROM image, loaded at the start (if the file exists) and saved at the end
+*	-q: don't print the pin changes
+*
+*	Output (one event per line, time in us):
+*	<time> PORTB/PORTC/PORTD <value>	- a port changed
+*	<time> TX <value> <char>			- the controller sent a char
+*	# ...								- summary at the end, including the rpm and the high time of each pin
+*
+*	For further information, read "simulation.h" and the "readme.txt" of the kombiinstrument project.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-10-08
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "simulation.h"
+
+#define SIM_LOOP_CYCLES 200 // cycles of the code between two calls of sei()
+#define SIM_TCNT1_CYCLES 8 // cycles between two reads of TCNT1 (busy-waiting)
+#define SIM_EEPROM_CYCLES (F_CPU * 85 / 10000) // an EEPROM write takes 8.5 ms
+#define SIM_TIMER_PRESCALER 8 // timer1 and timer2 run with 1 MHz
+#define SIM_RPM_CYCLES (F_CPU * 30) // 2 signals per round, 60s per round -> cycles between two signals for 1 RPM
+#define SIM_EE_RDY_LIMIT 1000 // calls of the EEPROM ready interrupt without write, before the simulation gives up
+
+#define EEPROM_SIZE 512
+#define MAX_INPUT 4096 // chars sent via UART
+#define MAX_RPM 64 // rpm changes
+#define NO_EVENT UINT64_MAX
+
+// interrupt routines of the firmware, the ones which aren't compiled are zero
+void INT0_vect(void) __attribute__((weak));
+void TIMER2_COMP_vect(void) __attribute__((weak));
+void TIMER1_CAPT_vect(void) __attribute__((weak));
+void TIMER1_COMPA_vect(void) __attribute__((weak));
+void TIMER1_OVF_vect(void) __attribute__((weak));
+void USART_RXC_vect(void) __attribute__((weak));
+void USART_TXC_vect(void) __attribute__((weak));
+void EE_RDY_vect(void) __attribute__((weak));
+
+int kombiMain(void); // main of the firmware, renamed by the Makefile
+extern uint16_t rpm, newRpm; // filtered and last measured rpm of the firmware, printed in the summary
+
+// ==================================== [registers] ==========================================
+
+volatile uint8_t DDRB, DDRC, DDRD, PORTB, PORTC, PORTD, PINB, PINC, PIND;
+volatile uint8_t TCCR1A, TCCR1B, TCCR2, OCR2, TIMSK, TIFR, MCUCR, GICR, GIFR;
+volatile uint8_t UCSRA, UCSRB, UCSRC, UBRRH, UBRRL;
+volatile uint8_t EECR, EEARL, EEARH;
+volatile uint16_t OCR1A, ICR1;
+volatile uint16_t simUdr = SIM_UDR_EMPTY;
+
+// ==================================== [variables] ==========================================
+
+static uint64_t simTime; // cycles since reset
+static uint64_t simEnd; // end of the simulation
+static uint8_t simInterrupts; // global interrupt flag
+static uint8_t simInIsr; // an interrupt routine is running
+static uint8_t simWoken; // an interrupt was delivered since the last simCli
+static uint8_t simQuiet; // don't print the pin changes
+
+static uint64_t timer2Next; // next compare of timer2
+
+static uint32_t rpmTimes[MAX_RPM]; // ms at which the rpm changes
+static uint16_t rpmValues[MAX_RPM];
+static uint8_t rpmCount;
+static uint8_t rpmIndex; // next rpm change
+static uint16_t rpmCurrent;
+static uint64_t rpmNext; // next rpm signal
+
+static uint32_t noiseTimes[MAX_RPM]; // ms at which the rate of the noise changes
+static uint16_t noiseValues[MAX_RPM];
+static uint8_t noiseCount;
+static uint8_t noiseIndex; // next change of the noise
+static uint16_t noiseCurrent;
+static uint64_t noiseNext = NO_EVENT; // next noise edge
+static uint32_t noiseRandom = 1; // state of the random generator, fixed seed for repeatable runs
+
+static uint8_t input[MAX_INPUT]; // chars to be received by the controller
+static uint64_t inputTimes[MAX_INPUT]; // earliest time of each char
+static uint16_t inputCount;
+static uint16_t inputIndex; // next char to be received
+static uint64_t rxEnd; // end of the last received char
+static uint8_t rxData; // received char, waiting for the interrupt
+
+static uint64_t txEnd = NO_EVENT; // end of the char being sent
+static unsigned long txCount;
+
+static uint8_t eeprom[EEPROM_SIZE];
+static volatile uint8_t eedr;
+static uint64_t eeEnd = NO_EVENT; // end of the running EEPROM write
+static char *eepromFile;
+
+static volatile uint8_t *ports[3] = {&PORTB, &PORTC, &PORTD};
+static char *portNames[3] = {"PORTB", "PORTC", "PORTD"};
+static uint8_t portValues[3]; // last printed value of each port
+static uint64_t portTimes[3]; // time of the last change of each port
+static uint64_t pinHigh[3][8]; // cycles each pin was high
+
+// ==================================== [function declaration] ==========================================
+
+static void simAdvance(uint64_t target); // moves the clock, raises all due events and delivers them
+static uint64_t simNextEvent(void); // returns the time of the next event
+static void simRaise(uint64_t time); // moves the clock to time and raises the flags of the events up to it
+static void simDeliver(void); // calls the interrupt routines of all pending and enabled interrupts
+static void simCall(void (*isr)(void)); // calls one interrupt routine
+static void simCheckWrites(void); // handles writes of the firmware to UDR and EECR
+static void simLogPins(void); // prints and accumulates the changes of the ports
+static uint64_t simByteCycles(void); // cycles of one char (start, 8 data and stop bit) at the configured baudrate
+static void simFinish(void); // prints the summary, saves the EEPROM and ends the program
+static uint64_t parseTime(char **argument); // reads an optional "<ms>:" prefix
+static void addInput(uint64_t time, uint8_t *data, long length); // queues chars to be received
+static void sortChanges(uint32_t *times, uint16_t *values, uint8_t count); // sorts the changes of rpm or noise by time
+static uint64_t noiseInterval(void); // random cycles until the next noise edge (mean 1/noiseCurrent s)
+
+// ==================================== [program start] ==========================================
+
+int main(int argc, char **argv)
+{
+	simEnd = (uint64_t) F_CPU; // 1 s
+	for(int i=1; i < argc; i++)
+	{
+		char *argument = argv[i+1];
+		if(!strcmp(argv[i], "-q"))
+		{
+			simQuiet = 1;
+			continue;
+		}
+		if(i+1 >= argc)
+		{
+			printf("Fehler! Parameter fuer \"%s\" fehlt.\n", argv[i]);
+			return 1;
+		}
+		i++;
+		if(!strcmp(argv[i-1], "-t"))
+			simEnd = (uint64_t) strtoul(argument, 0, 10) * (F_CPU / 1000);
+		else if(!strcmp(argv[i-1], "-r") && rpmCount < MAX_RPM)
+		{
+			rpmTimes[rpmCount] = parseTime(&argument) / (F_CPU / 1000);
+			rpmValues[rpmCount] = strtoul(argument, 0, 10);
+			rpmCount++;
+		}
+		else if(!strcmp(argv[i-1], "-n") && noiseCount < MAX_RPM)
+		{
+			noiseTimes[noiseCount] = parseTime(&argument) / (F_CPU / 1000);
+			noiseValues[noiseCount] = strtoul(argument, 0, 10);
+			noiseCount++;
+		}
+		else if(!strcmp(argv[i-1], "-u"))
+		{
+			uint64_t time = parseTime(&argument);
+			addInput(time, (uint8_t *) argument, strlen(argument));
+		}
+		else if(!strcmp(argv[i-1], "-f"))
+		{
+			uint64_t time = parseTime(&argument);
+			FILE *file = fopen(argument, "rb");
+			if(!file)
+			{
+				printf("Fehler! Datei \"%s\" wurde nicht gefunden!\n", argument);
+				return 1;
+			}
+			uint8_t data[MAX_INPUT];
+			long length = fread(data, 1, MAX_INPUT, file);
+			fclose(file);
+			addInput(time, data, length);
+		}
+		else if(!strcmp(argv[i-1], "-e"))
+			eepromFile = argument;
+		else
+		{
+			printf("Fehler! Unbekannter Parameter \"%s\".\n", argv[i-1]);
+			printf("-> kombiSim [-t <ms>] [-r [<ms>:]<rpm>] [-n [<ms>:]<rate>] [-u [<ms>:]<text>] [-f [<ms>:]<file>] [-e <file>] [-q]\n");
+			return 1;
+		}
+	}
+
+	memset(eeprom, 0xFF, EEPROM_SIZE); // erased EEPROM
+	if(eepromFile)
+	{
+		FILE *file = fopen(eepromFile, "rb");
+		if(file)
+		{
+			if(fread(eeprom, 1, EEPROM_SIZE, file) != EEPROM_SIZE)
+				printf("# EEPROM-Abbild ist unvollstaendig\n");
+			fclose(file);
+		}
+	}
+
+	sortChanges(rpmTimes, rpmValues, rpmCount);
+	sortChanges(noiseTimes, noiseValues, noiseCount);
+	rpmNext = NO_EVENT;
+
+	kombiMain(); // returns never, the simulation ends in simRaise
+	return 0;
+}
+
+// ==================================== [avr functions] ==========================================
+
+void simSei(void)
+{
+	simInterrupts = 1;
+	simCheckWrites();
+	simAdvance(simTime + SIM_LOOP_CYCLES);
+}
+
+void simCli(void)
+{
+	simInterrupts = 0;
+	simWoken = 0;
+}
+
+void simSleep(void)
+{
+	simCheckWrites();
+	if(simWoken) // the interrupt, which would wake up the controller, was already delivered
+	{
+		simWoken = 0;
+		return;
+	}
+	uint64_t next = simNextEvent();
+	if(next > simEnd)
+		next = simEnd;
+	simAdvance(next);
+	simWoken = 0;
+}
+
+uint16_t simTcnt1(void)
+{
+	simLogPins(); // the compare interrupt may write several edges while waiting for the counter
+	simRaise(simTime + SIM_TCNT1_CYCLES);
+	if(!(TCCR1B & 7)) // timer stopped
+		return 0;
+	return (simTime / SIM_TIMER_PRESCALER) & 0xFFFF;
+}
+
+volatile uint8_t *simEedr(void)
+{
+	if(EECR & (1 << EERE)) // read the addressed byte
+	{
+		eedr = eeprom[((EEARH << 8) | EEARL) % EEPROM_SIZE];
+		EECR &= ~(1 << EERE);
+	}
+	return &eedr;
+}
+
+uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data)
+{
+	crc ^= (uint16_t) data << 8;
+	for(uint8_t i=0; i < 8; i++)
+	{
+		if(crc & 0x8000)
+			crc = (crc << 1) ^ 0x1021;
+		else
+			crc <<= 1;
+	}
+	return crc;
+}
+
+// ==================================== [virtual clock] ==========================================
+
+static void simAdvance(uint64_t target)
+{
+	while(1)
+	{
+		uint64_t next = simNextEvent();
+		if(next > target)
+			break;
+		simRaise(next);
+		simDeliver();
+	}
+	simRaise(target);
+	simDeliver();
+}
+
+static uint64_t simNextEvent(void)
+{
+	uint64_t next = simEnd;
+	if((TCCR2 & 7) && timer2Next < next)
+		next = timer2Next;
+
+	if(TCCR1B & 7)
+	{
+		uint64_t ticks = simTime / SIM_TIMER_PRESCALER;
+		uint64_t compare = ticks + 1 + ((OCR1A - ticks - 1) & 0xFFFF);
+		uint64_t overflow = (ticks / 0x10000 + 1) * 0x10000;
+		if(compare * SIM_TIMER_PRESCALER < next)
+			next = compare * SIM_TIMER_PRESCALER;
+		if(overflow * SIM_TIMER_PRESCALER < next)
+			next = overflow * SIM_TIMER_PRESCALER;
+	}
+
+	if(rpmIndex < rpmCount && (uint64_t) rpmTimes[rpmIndex] * (F_CPU / 1000) < next)
+		next = (uint64_t) rpmTimes[rpmIndex] * (F_CPU / 1000);
+	if(rpmNext < next)
+		next = rpmNext;
+	if(noiseIndex < noiseCount && (uint64_t) noiseTimes[noiseIndex] * (F_CPU / 1000) < next)
+		next = (uint64_t) noiseTimes[noiseIndex] * (F_CPU / 1000);
+	if(noiseNext < next)
+		next = noiseNext;
+
+	if(inputIndex < inputCount && (UCSRB & (1 << RXEN)))
+	{
+		uint64_t start = inputTimes[inputIndex];
+		if(rxEnd > start)
+			start = rxEnd;
+		if(start + simByteCycles() < next)
+			next = start + simByteCycles();
+	}
+	if(txEnd < next)
+		next = txEnd;
+	if(eeEnd < next)
+		next = eeEnd;
+	if(next < simTime)
+		next = simTime;
+	return next;
+}
+
+static void simRaise(uint64_t time)
+{
+	if(time > simEnd)
+		time = simEnd;
+	if(time < simTime) // interrupt routines reading TCNT1 may have moved the clock beyond the target
+		time = simTime;
+	uint64_t last = simTime;
+	simTime = time;
+
+	// timer2, ctc mode with OCR2
+	uint64_t period = ((uint64_t) OCR2 + 1) * SIM_TIMER_PRESCALER;
+	if(!(TCCR2 & 7))
+		timer2Next = time + period;
+	while(timer2Next <= time)
+	{
+		TIFR |= (1 << OCF2);
+		timer2Next += period;
+	}
+
+	// timer1, normal mode
+	if(TCCR1B & 7)
+	{
+		uint64_t ticksLast = last / SIM_TIMER_PRESCALER;
+		uint64_t ticks = time / SIM_TIMER_PRESCALER;
+		if(ticks - ticksLast > 0xFFFF || ((OCR1A - ticksLast - 1) & 0xFFFF) < ticks - ticksLast)
+			TIFR |= (1 << OCF1A);
+		if(ticks / 0x10000 != ticksLast / 0x10000)
+			TIFR |= (1 << TOV1);
+	}
+
+	// rpm signal
+	while(rpmIndex < rpmCount && (uint64_t) rpmTimes[rpmIndex] * (F_CPU / 1000) <= time)
+	{
+		uint64_t change = (uint64_t) rpmTimes[rpmIndex] * (F_CPU / 1000);
+		rpmCurrent = rpmValues[rpmIndex++];
+		rpmNext = NO_EVENT;
+		if(rpmCurrent)
+			rpmNext = change + SIM_RPM_CYCLES / rpmCurrent;
+	}
+	while(rpmNext <= time)
+	{
+		GIFR |= (1 << INTF0);
+		TIFR |= (1 << ICF1);
+		ICR1 = (rpmNext / SIM_TIMER_PRESCALER) & 0xFFFF;
+		rpmNext += SIM_RPM_CYCLES / rpmCurrent;
+	}
+	while(noiseIndex < noiseCount && (uint64_t) noiseTimes[noiseIndex] * (F_CPU / 1000) <= time)
+	{
+		uint64_t change = (uint64_t) noiseTimes[noiseIndex] * (F_CPU / 1000);
+		noiseCurrent = noiseValues[noiseIndex++];
+		noiseNext = NO_EVENT;
+		if(noiseCurrent)
+			noiseNext = change + noiseInterval();
+	}
+	while(noiseNext <= time)
+	{
+		GIFR |= (1 << INTF0);
+		TIFR |= (1 << ICF1);
+		ICR1 = (noiseNext / SIM_TIMER_PRESCALER) & 0xFFFF;
+		noiseNext += noiseInterval();
+	}
+
+	// uart
+	while(inputIndex < inputCount && (UCSRB & (1 << RXEN)))
+	{
+		uint64_t start = inputTimes[inputIndex];
+		if(rxEnd > start)
+			start = rxEnd;
+		if(start + simByteCycles() > time)
+			break;
+		rxEnd = start + simByteCycles();
+		if(UCSRA & (1 << RXC)) // the previous char gets lost, if it wasn't read (data overrun)
+			UCSRA |= (1 << DOR);
+		rxData = input[inputIndex++];
+		UCSRA |= (1 << RXC);
+	}
+	if(txEnd <= time)
+	{
+		txEnd = NO_EVENT;
+		UCSRA |= (1 << TXC);
+	}
+
+	// EEPROM
+	if(eeEnd <= time)
+	{
+		eeEnd = NO_EVENT;
+		EECR &= ~(1 << EEWE);
+	}
+
+	if(simTime >= simEnd)
+		simFinish();
+}
+
+static void simDeliver(void)
+{
+	if(!simInterrupts || simInIsr)
+		return;
+	uint16_t eeCalls = 0;
+	while(1) // highest priority first (vector number)
+	{
+		if((GIFR & (1 << INTF0)) && (GICR & (1 << INT0)) && INT0_vect)
+		{
+			GIFR &= ~(1 << INTF0);
+			simCall(INT0_vect);
+		}
+		else if((TIFR & (1 << OCF2)) && (TIMSK & (1 << OCIE2)) && TIMER2_COMP_vect)
+		{
+			TIFR &= ~(1 << OCF2);
+			simCall(TIMER2_COMP_vect);
+		}
+		else if((TIFR & (1 << ICF1)) && (TIMSK & (1 << TICIE1)) && TIMER1_CAPT_vect)
+		{
+			TIFR &= ~(1 << ICF1);
+			simCall(TIMER1_CAPT_vect);
+		}
+		else if((TIFR & (1 << OCF1A)) && (TIMSK & (1 << OCIE1A)) && TIMER1_COMPA_vect)
+		{
+			TIFR &= ~(1 << OCF1A);
+			simCall(TIMER1_COMPA_vect);
+		}
+		else if((TIFR & (1 << TOV1)) && (TIMSK & (1 << TOIE1)) && TIMER1_OVF_vect)
+		{
+			TIFR &= ~(1 << TOV1);
+			simCall(TIMER1_OVF_vect);
+		}
+		else if((UCSRA & (1 << RXC)) && (UCSRB & (1 << RXCIE)) && USART_RXC_vect)
+		{
+			simUdr = rxData; // reading UDR clears RXC
+			UCSRA &= ~(1 << RXC);
+			simCall(USART_RXC_vect);
+			UCSRA &= ~(1 << DOR); // the flag belongs to the char read by the routine
+		}
+		else if((UCSRA & (1 << TXC)) && (UCSRB & (1 << TXCIE)) && USART_TXC_vect)
+		{
+			UCSRA &= ~(1 << TXC);
+			simCall(USART_TXC_vect);
+		}
+		else if((EECR & (1 << EERIE)) && !(EECR & (1 << EEWE)) && EE_RDY_vect)
+		{
+			if(++eeCalls > SIM_EE_RDY_LIMIT)
+			{
+				printf("# Fehler! EEPROM-Interrupt wird nicht beendet\n");
+				simFinish();
+			}
+			simCall(EE_RDY_vect);
+		}
+		else
+			break;
+	}
+}
+
+static void simCall(void (*isr)(void))
+{
+	simInIsr = 1;
+	simInterrupts = 0;
+	isr();
+	simInterrupts = 1;
+	simInIsr = 0;
+	simWoken = 1;
+	if(isr == USART_RXC_vect) // the routine read the received char, it wasn't written to be sent
+		simUdr = SIM_UDR_EMPTY;
+	simCheckWrites();
+}
+
+static void simCheckWrites(void)
+{
+	simLogPins();
+	if(simUdr != SIM_UDR_EMPTY) // a char was written to be sent
+	{
+		uint8_t value = simUdr;
+		simUdr = SIM_UDR_EMPTY;
+		if(UCSRB & (1 << TXEN))
+		{
+			printf("%.3f TX 0x%02X %c\n", (double) simTime * 1000000 / F_CPU, value,
+				value >= ' ' && value < 127 ? value : '.');
+			txCount++;
+			txEnd = simTime + simByteCycles();
+		}
+	}
+	if((EECR & (1 << EEWE)) && eeEnd == NO_EVENT) // a write was started
+	{
+		if(EECR & (1 << EEMWE))
+			eeprom[((EEARH << 8) | EEARL) % EEPROM_SIZE] = eedr;
+		EECR &= ~(1 << EEMWE);
+		eeEnd = simTime + SIM_EEPROM_CYCLES;
+	}
+}
+
+static void simLogPins(void)
+{
+	for(uint8_t i=0; i < 3; i++)
+	{
+		uint8_t value = *ports[i];
+		if(value == portValues[i])
+			continue;
+		for(uint8_t bit=0; bit < 8; bit++)
+			if(portValues[i] & (1 << bit))
+				pinHigh[i][bit] += simTime - portTimes[i];
+		portValues[i] = value;
+		portTimes[i] = simTime;
+		if(!simQuiet)
+			printf("%.3f %s 0x%02X\n", (double) simTime * 1000000 / F_CPU, portNames[i], value);
+	}
+}
+
+static uint64_t simByteCycles(void)
+{
+	uint16_t ubrr = ((UBRRH & 0x0F) << 8) | UBRRL;
+	uint8_t cycles = 16;
+	if(UCSRA & (1 << U2X))
+		cycles = 8;
+	return (uint64_t) 10 * cycles * (ubrr + 1);
+}
+
+static void simFinish(void)
+{
+	simLogPins();
+	for(uint8_t i=0; i < 3; i++) // the current state of each port counts until the end
+	{
+		for(uint8_t bit=0; bit < 8; bit++)
+			if(portValues[i] & (1 << bit))
+				pinHigh[i][bit] += simTime - portTimes[i];
+		portTimes[i] = simTime;
+	}
+
+	printf("# time: %.3f ms\n", (double) simTime * 1000 / F_CPU);
+	printf("# chars received: %u sent: %lu\n", (unsigned int) inputIndex, txCount);
+	printf("# rpm: %u measured: %u\n", rpm, newRpm);
+	for(uint8_t i=0; i < 3; i++)
+		for(uint8_t bit=0; bit < 8; bit++)
+			if(pinHigh[i][bit])
+				printf("# %s%u high: %.2f %%\n", portNames[i], bit, simTime ? 100.0 * pinHigh[i][bit] / simTime : 0);
+
+	if(eepromFile)
+	{
+		FILE *file = fopen(eepromFile, "wb");
+		if(file)
+		{
+			fwrite(eeprom, 1, EEPROM_SIZE, file);
+			fclose(file);
+		}
+		else
+			printf("# Fehler! EEPROM-Abbild konnte nicht gespeichert werden\n");
+	}
+	exit(0);
+}
+
+// ==================================== [arguments] ==========================================
+
+static uint64_t parseTime(char **argument)
+{
+	char *separator = strchr(*argument, ':');
+	if(!separator)
+		return 0;
+	uint64_t time = (uint64_t) strtoul(*argument, 0, 10) * (F_CPU / 1000);
+	*argument = separator + 1;
+	return time;
+}
+
+static void addInput(uint64_t time, uint8_t *data, long length)
+{
+	// the chars are received in the order of their times
+	for(long i=0; i < length && inputCount < MAX_INPUT; i++)
+	{
+		uint16_t k = inputCount;
+		for(; k > 0 && inputTimes[k-1] > time; k--)
+		{
+			input[k] = input[k-1];
+			inputTimes[k] = inputTimes[k-1];
+		}
+		input[k] = data[i];
+		inputTimes[k] = time;
+		inputCount++;
+	}
+}
+
+static void sortChanges(uint32_t *times, uint16_t *values, uint8_t count)
+{
+	for(uint8_t i=1; i < count; i++)
+	{
+		for(uint8_t j=i; j > 0 && times[j-1] > times[j]; j--)
+		{
+			uint32_t time = times[j];
+			uint16_t value = values[j];
+			times[j] = times[j-1];
+			values[j] = values[j-1];
+			times[j-1] = time;
+			values[j-1] = value;
+		}
+	}
+}
+
+static uint64_t noiseInterval(void)
+{
+	noiseRandom ^= noiseRandom << 13; // xorshift32
+	noiseRandom ^= noiseRandom >> 17;
+	noiseRandom ^= noiseRandom << 5;
+	return 1 + (uint64_t) noiseRandom % (2 * F_CPU / noiseCurrent); // uniform, twice the mean at most
+}
@@ -0,0 +1,108 @@
+// ==================================== [simulation.h] =============================
+/*
+*	Replaces the avr headers for the host build of the controller firmware ("make sim").
+*
+*	The registers used by the firmware are plain variables. The simulation runs the firmware on a
+*	virtual clock of F_CPU and calls the interrupt routines when their events are due:
+*	-TIMER2 compare (time-base), TIMER1 compare, overflow and input capture (pwm and rpm)
+*	-INT0 (rpm signal, generated from the given rpm)
+*	-UART RX and TX complete (with the timing of the configured baudrate)
+*	-EEPROM ready (with the write time of the EEPROM)
+*
+*	The clock advances, when the firmware enables the interrupts (a fixed time per call), waits
+*	for an interrupt (sleep_cpu, HAL_WAIT) or reads TCNT1. Pending interrupts are delivered at
+*	these points as long as the interrupts are enabled. The duration of the code in between isn't
+*	simulated, so the timing is only approximated.
+*
+*	Author: Tobias Brächter
+*	Last update: 2019-10-08
+*
+*/
+
+#ifndef _SIMULATION_H_
+#define _SIMULATION_H_
+
+#include <stdint.h>
+
+// ==================================== [registers] ==========================================
+
+extern volatile uint8_t DDRB, DDRC, DDRD, PORTB, PORTC, PORTD, PINB, PINC, PIND;
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR2, OCR2, TIMSK, TIFR, MCUCR, GICR, GIFR;
+extern volatile uint8_t UCSRA, UCSRB, UCSRC, UBRRH, UBRRL;
+extern volatile uint8_t EECR, EEARL, EEARH;
+extern volatile uint16_t OCR1A, ICR1;
+extern volatile uint16_t simUdr; // SIM_UDR_EMPTY until the firmware writes a char to be sent
+
+#define SIM_UDR_EMPTY 0x100
+
+#define UDR simUdr
+#define TCNT1 simTcnt1() // the counter only advances while it is read
+#define EEDR (*simEedr()) // the read enable of EECR loads the data on access
+
+uint16_t simTcnt1(void);
+volatile uint8_t *simEedr(void);
+
+// bits of the ATmega8 registers
+#define WGM21 3
+#define WGM20 6
+#define CS22 2
+#define CS21 1
+#define CS20 0
+#define OCIE2 7
+#define TICIE1 5
+#define OCIE1A 4
+#define TOIE1 2
+#define OCF2 7
+#define ICF1 5
+#define OCF1A 4
+#define TOV1 2
+#define ICNC1 7
+#define ICES1 6
+#define CS11 1
+#define RXC 7
+#define TXC 6
+#define FE 4
+#define DOR 3
+#define U2X 1
+#define RXCIE 7
+#define TXCIE 6
+#define RXEN 4
+#define TXEN 3
+#define UCSZ2 2
+#define URSEL 7
+#define UCSZ1 2
+#define UCSZ0 1
+#define ISC01 1
+#define ISC00 0
+#define INT0 6
+#define INTF0 6
+#define EERIE 3
+#define EEMWE 2
+#define EEWE 1
+#define EERE 0
+
+// ==================================== [avr functions] ==========================================
+
+#define ISR(vector) void vector(void)
+
+#define sei() simSei()
+#define cli() simCli()
+
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu() simSleep()
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *) (address))
+#define pgm_read_word(address) (*(const uint16_t *) (address))
+
+#define HAL_WAIT() simSleep()
+
+void simSei(void); // enables the interrupts and advances the clock by the time of one main loop pass
+void simCli(void); // disables the interrupts
+void simSleep(void); // advances the clock to the next interrupt, unless one was delivered since simCli
+uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data);
+
+#endif
@@ -19,91 +19,111 @@
 *
 */
 
+#include <string.h>
+
 #include "charBuffer.h"
 
-void cb_initBuffer(cb_charBuffer *this, uint8_t *buffer, uint8_t size)
+void cb_initBuffer(cb_charBuffer *this, uint8_t *buffer, uint16_t size)
 {
 	this->buffer = buffer;
-	this->size = size;
-	this->read = 0;
-	this->write = 0;
-	this->stored = 0;
+	this->mask = size-1;
+	this->head = 0;
+	this->tail = 0;
 }
 
 void cb_clearBuffer(cb_charBuffer *this)
 {
-	this->read = 0;
-	this->write = 0;
-	this->stored = 0;
+	this->tail = this->head;
 }
 
 uint8_t cb_hasNext(cb_charBuffer *this)
 {
-	return this->stored;
+	return (this->head-this->tail) & this->mask;
 }
 
-void cb_put(cb_charBuffer *this, uint8_t value)
+uint8_t cb_getFree(cb_charBuffer *this)
 {
-	uint8_t next = (this->write+1)%(this->size);
-	if(next != this->read)
-	{
-		this->buffer[this->write] = value;
-		this->write = next;
-		this->stored = this->stored+1;
-	}
+	return (this->tail-this->head-1) & this->mask;
 }
 
-void cb_putN(cb_charBuffer *this, uint8_t *values, uint8_t amount)
+uint8_t cb_put(cb_charBuffer *this, uint8_t value)
 {
-	for(uint8_t i = 0; i < amount; i++)
-		cb_put(this, values[i]);
+	uint8_t head = this->head;
+	uint8_t next = (head+1) & this->mask;
+	if(next == this->tail)
+		return 0;
+	this->buffer[head] = value;
+	CB_BARRIER();
+	this->head = next;
+	return 1;
+}
+
+uint8_t cb_putN(cb_charBuffer *this, uint8_t *values, uint8_t amount)
+{
+	uint8_t free = cb_getFree(this);
+	if(amount > free)
+		amount = free;
+
+	// copy up to the end of the array, the rest starts at the beginning
+	uint8_t head = this->head;
+	uint16_t span = this->mask+1-head;
+	if(span > amount)
+		span = amount;
+	memcpy(this->buffer+head, values, span);
+	memcpy(this->buffer, values+span, amount-span);
+	CB_BARRIER();
+	this->head = (head+amount) & this->mask;
+	return amount;
 }
 
 void cb_putString(cb_charBuffer *this, uint8_t *values)
 {
-	uint8_t i = 0;
-	while(values[i])
-		cb_put(this, values[i++]);
+	cb_putN(this, values, strlen((char *) values));
 }
 
 uint8_t cb_getNext(cb_charBuffer *this)
 {
-	if(this->stored)
-		return this->buffer[this->read];
+	if(this->head != this->tail)
+		return this->buffer[this->tail];
 	return 0;
 }
 
 uint8_t cb_getNextOff(cb_charBuffer *this, uint8_t offset)
 {
-	if(offset >= this->stored)
+	if(offset >= cb_hasNext(this))
 		return 0;
-	uint8_t next = (this->read+offset)%(this->size);
-	return this->buffer[next];
+	return this->buffer[(this->tail+offset) & this->mask];
 }
 
 void cb_getNextN(cb_charBuffer *this, uint8_t *values, uint8_t amount)
 {
-	for(uint8_t i = 0; i < amount; i++)
-	{
-		uint8_t next = (this->read+i)%(this->size);
-		if(i < this->stored)
-			values[i] = this->buffer[next];
-		else
-			values[i] = 0;
-	}
+	uint8_t stored = cb_hasNext(this);
+	if(stored > amount)
+		stored = amount;
+
+	uint8_t tail = this->tail;
+	uint16_t span = this->mask+1-tail;
+	if(span > stored)
+		span = stored;
+	memcpy(values, this->buffer+tail, span);
+	memcpy(values+span, this->buffer, stored-span);
+	memset(values+stored, 0, amount-stored);
 }
 
 void cb_delete(cb_charBuffer *this)
 {
-	if(this->stored)
+	if(this->head != this->tail)
 	{
-		this->read = (this->read+1)%(this->size);
-		this->stored = this->stored-1;
+		CB_BARRIER();
+		this->tail = (this->tail+1) & this->mask;
 	}
 }
 
 void cb_deleteN(cb_charBuffer *this, uint8_t amount)
 {
-	for(uint8_t i = 0; i < amount; i++)
-		cb_delete(this);
+	uint8_t stored = cb_hasNext(this);
+	if(amount > stored)
+		amount = stored;
+	CB_BARRIER();
+	this->tail = (this->tail+amount) & this->mask;
 }
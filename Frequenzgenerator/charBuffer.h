@@ -10,9 +10,15 @@
 *	calling "cb_initBuffer(...)" with the right parameters, you can use the other
 *	functions.
 *
+*	The buffer is meant for one producer and one consumer (e.g. an interrupt and the main
+*	loop). The producer only changes "head" (put-functions), the consumer only changes "tail"
+*	(get- and delete-functions, cb_clearBuffer). Both indices are single bytes, so they can be
+*	used from an interrupt and the main loop without disabling interrupts.
+*
 *	CAUTION: There is no error handling for errors caused through missing cb_charBuffer
 *				or buffer-array. You have to make sure that the buffer is initialized
-*				correctly.
+*				correctly. The size of the buffer has to be a power of two (max. 256),
+*				one char of it stays unused to distinguish a full from an empty buffer.
 *
 *	Author: Tobias Brächter
 *	Last update: 2019-05-13
@@ -24,35 +30,42 @@
 
 #include <stdint.h>
 
+// keeps the compiler from moving memory accesses across it, e.g. the access of the chars behind
+// the update of an index
+#define CB_BARRIER() __asm__ __volatile__("" ::: "memory")
+
 // Struct to store the needed data for the buffer
 typedef struct
 {
 	uint8_t *buffer;
-	uint8_t size;
-	uint8_t read;
-	uint8_t write;
-	uint8_t stored;
+	uint8_t mask; // size - 1
+	volatile uint8_t head; // next index to be written, only changed by the producer
+	volatile uint8_t tail; // next index to be read, only changed by the consumer
 }
 cb_charBuffer;
 
 // Used to initialize the buffer. This function must be called before any other function.
 //	The struct cb_charBuffer und the buffer-array have to be declared by the user.
-void cb_initBuffer(cb_charBuffer *this, uint8_t *buffer, uint8_t size);
+//	<size> has to be a power of two up to 256.
+void cb_initBuffer(cb_charBuffer *this, uint8_t *buffer, uint16_t size);
 
-// Deletes all data stored in the buffer.
+// Deletes all data stored in the buffer (consumer).
 void cb_clearBuffer(cb_charBuffer *this);
 
 // Returns the amount of chars stored in the buffer.
 uint8_t cb_hasNext(cb_charBuffer *this);
 
+// Returns the amount of chars, which can still be inserted.
+uint8_t cb_getFree(cb_charBuffer *this);
+
 // Inserts a char into the buffer.
-//	If the buffer is full, the action will be ignored.
-void cb_put(cb_charBuffer *this, uint8_t value);
+//	If the buffer is full, the action will be ignored. Returns 1 if the char was inserted.
+uint8_t cb_put(cb_charBuffer *this, uint8_t value);
 
 // Inserts <amount> chars into the buffer from the given buffer.
 // Chars are only inserted, while the buffer is full. All remaining
-// chars will be ignored.
-void cb_putN(cb_charBuffer *this, uint8_t *values, uint8_t amount);
+// chars will be ignored. Returns the number of inserted chars.
+uint8_t cb_putN(cb_charBuffer *this, uint8_t *values, uint8_t amount);
 
 // Inserts a string from the given buffer into the buffer.
 // The chars are inserted until the zero-terminator is found or the
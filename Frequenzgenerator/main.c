@@ -48,7 +48,7 @@
 #define INDATA 0
 #define OUTDATA 1
 
-#define IO_BUFFER_SIZE 50
+#define IO_BUFFER_SIZE 64 // power of two
 
 #define MODE_RUNNING 0
 #define MODE_AIN 1
@@ -135,7 +135,7 @@ void initialize(void)
 	setBit(&DDRD, 1, 1); // TX0 as output
 
 	// timer setup
-	OCR2 = 100; // time-base 100us
+	OCR2 = 99; // time-base 100us, ctc counts from 0 to OCR2
 	setBit(&TCCR2, WGM21, 1); // ctc mode
 	setBit(&TCCR2, WGM20, 0);
 	setBit(&TIMSK, OCIE2, 1); // enable compare match interrupt
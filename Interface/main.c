@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
 
 #include "serialCommunication.h"
 #include "kombiData.h"
@@ -21,8 +22,26 @@
 #define COM_BUFFER 30
 
 #define SERIAL_READ_TIMEOUT 2
+#define SERIAL_SAVE_TIMEOUT 4 // writing the EEPROM takes more than one second
+
+#define PATCH_GAP 5 // unchanged bytes between two changes, which are sent instead of starting a new patch (header + terminator)
+
+#define STREAM_FILE_BUFFER 65536 // the log file is written in large blocks while streaming
+#define STREAM_MAX_INTERVAL 255 // ms, the interval is sent as one byte
+#define PWM_TICKS 2048 // duty cycle of 100% in the telemetry frames
+#define SCOPE_POLL 500 // ms between two requests while waiting for the capture
+#define SCOPE_ROWS 12 // height of the plot of the capture
+#define RPM_PERIOD 30000000.0 // rpm * period in us, the signal comes twice per round
+#define MISFIRE_FACTOR 1.5 // periods this much longer than their neighbours are marked as possible misfires
+
+#define KOMBIDATA_MIN_SIZE 130 // size of the first kombiData version, newer parameters are appended
 
 int loadingScript;
+int readTimeout = SERIAL_READ_TIMEOUT; // timeout for reading answers in seconds
+int sentValid; // shows if kdSent equals the cache of the controller
+int baudIndex; // index of the baudrate used with the controller
+long baudRates[NUM_BAUD] = BAUD_RATES;
+int autoUpdate; // if true, every change gets sent to the controller
 int exitProgram;
 
 void handleInput(void);
@@ -34,6 +53,12 @@ void cm_saveFile(void); // save kombiData to file
 void cm_loadData(void); // load kombiData to the controller
 void cm_getData(void); // load kombiData from the controller
 void cm_saveData(void); // save kombiData in the controller permanent
+void cm_profile(char type); // save, load or activate a profile stored in the controller
+void cm_update(void); // send the changed parts of kombiData to the controller and activate them
+int cm_patch(int offset, int length, int activate); // send a part of kombiData to the controller
+void cm_baudrate(void); // negotiate another baudrate with the controller
+int cm_setBaudrate(int index); // switch controller and port to the baudrate of the given index
+uint16_t cm_crc(uint16_t crc, uint8_t data); // update the crc (xmodem) with one byte
 int cm_readAnswer(char *buffer, int length); // try to read answer with given length
 int cm_readStatus(char *buffer); // try to read status from the controller
 void cm_loadScript(void); // load a command script
@@ -47,6 +72,14 @@ void cm_starter(void); // edit the starter parameters
 void cm_listStarter(void); // list the starter parameters
 void cm_filter(void); // edit the filter parameter
 void cm_listFilter(void); // list the filter parameter
+void cm_gamma(void); // edit the brightness correction
+void cm_listGamma(void); // list the brightness correction
+void cm_stats(void); // request and show the statistics of the controller
+void cm_stream(void); // record the telemetry stream of the controller to a file
+int cm_readStreamAnswer(char *buffer, time_t end, long *errors); // read the next frame or status of the stream, returns its command char or 0 on timeout
+void cm_scope(void); // capture the raw rpm periods around a trigger, analyse and plot them
+int cm_readScope(kombiScope *scope); // request the capture from the controller
+void cm_plotScope(kombiScope *scope); // plot the rpm of the captured periods
 void cm_plot(void); // plot the kombiData
 
 //variables
@@ -54,6 +87,7 @@ char inputBuffer[INPUT_BUFFER]; // buffer for reading complete line
 char command[COM_BUFFER]; // buffer for command line command
 
 kombiData kdActive, kdCache;
+kombiData kdSent; // data, which was last transferred to or from the controller
 char *pkdActive, *pkdCache;
 
 int main(void)
@@ -81,6 +115,8 @@ int main(void)
 	}
 	if(se_isPortOpen())
 	{
+		if(baudIndex)
+			cm_setBaudrate(0);
 		printf("Reservierter Port wird freigegeben...\n");
 		se_closePort();
 	}
@@ -100,11 +136,17 @@ void handleInput(void)
 		printf("-> listports - Listet die im System vorhandenen seriellen Schnittstellen auf.\n");
 		printf("-> openport <PORT> - Reserviert <PORT> als Kommunikationsport.\n");
 		printf("-> closeport - Gibt den reservierten Port wieder frei.\n");
+		printf("-> baudrate <rate> - Stellt Kombiinstrument und Port auf eine andere Baudrate um.\n");
 		printf("-> loadfile <filename> - Importiert die Daten aus der angegebenen Datei.\n");
 		printf("-> savefile <filename> - Exportiert die Daten in die angegebene Datei.\n");
 		printf("-> loaddata - Exportiert die aktuellen Daten in das Kombiinstrument.\n");
 		printf("-> getdata - Importiert die aktuellen Daten aus dem Kombiinstrument.\n");
+		printf("-> update - Uebertraegt nur die geaenderten Daten in das Kombiinstrument und aktiviert sie.\n");
+		printf("-> autoupdate <0/1> - Uebertraegt jede Aenderung sofort in das Kombiinstrument.\n");
 		printf("-> savedata - Speichert die aktuellen Daten im Kombiinstrument dauerhaft.\n");
+		printf("-> saveprofile <n> - Speichert die Daten im Cache des Kombiinstruments als Profil <n>.\n");
+		printf("-> loadprofile <n> - Laedt das Profil <n> in den Cache des Kombiinstruments.\n");
+		printf("-> activateprofile <n> - Laedt das Profil <n> und aktiviert es sofort.\n");
 		printf("-> loadscript <filename> - Importiert ein Befehls-Skript.\n");
 		printf("-> breakpoint <ID> <rpm> <red> <green> <blue> - Manipuliert die entsprechenden Daten.\n");
 		printf("-> listbreakpoints - Listet die Daten der breakpoints auf.\n");
@@ -114,8 +156,13 @@ void handleInput(void)
 		printf("-> listhysteresis - Listet die Hysterese-Parameter auf.\n");
 		printf("-> starter <rpmOn> <rpmOff> - Stellt die Grenzen der Starterfreigabe ein.\n");
 		printf("-> liststarter - Listet die Daten des Starters auf.\n");
-		printf("-> filter <time> - Stellt die Drehzahlwechselrate ein (1/100us).\n");
+		printf("-> filter <time> [<median> <ema>] - Stellt die Drehzahlwechselrate (1/100us) und die Drehzahlfilter ein.\n");
 		printf("-> listfilter - Listet die Daten des Filters auf.\n");
+		printf("-> gamma <0/1/2> - Stellt die Helligkeitskorrektur ein (0 = linear, 1 = Gamma 2.2, 2 = CIE 1931).\n");
+		printf("-> listgamma - Listet die Helligkeitskorrektur auf.\n");
+		printf("-> stream <ms> <s> <filename> - Zeichnet <s> Sekunden lang alle <ms> Millisekunden die Drehzahl und die Ausgaben auf (.csv als Text, sonst binaer).\n");
+		printf("-> scope <rpm> <s> [<filename>] - Zeichnet die Perioden des Drehzahlsignals ab <rpm> auf (0 = sofort, Firmware mit SCOPE=1).\n");
+		printf("-> stats - Zeigt Auslastung und Interrupt-Laufzeiten des Kombiinstruments seit der letzten Abfrage (Firmware mit STATS=1).\n");
 		printf("-> clearall - Setzt alle in kombiData gespeicherten Parameter auf null.\n");
 		printf("-> listall - Listet alle in kombiData gespeicherten Parameter auf.\n");
 		printf("-> plot - Stellt den Farbverlauf entsprechend der aktuellen Daten in einer Grafik dar.\n");
@@ -136,13 +183,18 @@ void handleInput(void)
 		else if(sscanf(inputBuffer, "openport %s", command) == 1)
 		{
 			if(se_openPort(command))
+			{
+				baudIndex = 0;
 				printf("Der Port \"%s\" wurde erfolgreich reserviert.\n", command);
+			}
 		}
 		else
 			printf("Fehler! Leerer Port nicht zugelassen.\n");
 	}
 	else if(!strcmp(command, "closeport"))
 	{
+		if(se_isPortOpen() && baudIndex) // the next connection starts with the default baudrate
+			cm_setBaudrate(0);
 		if(se_closePort())
 			printf("Port wurde erfolgreich freigegeben.\n");
 	}
@@ -154,8 +206,25 @@ void handleInput(void)
 		cm_loadData();
 	else if(!strcmp(command, "getdata"))
 		cm_getData();
+	else if(!strcmp(command, "baudrate"))
+		cm_baudrate();
+	else if(!strcmp(command, "update"))
+		cm_update();
+	else if(!strcmp(command, "autoupdate"))
+	{
+		if(sscanf(inputBuffer, "autoupdate %d", &autoUpdate) == 1)
+			printf("Automatische Uebertragung %s.\n", autoUpdate ? "aktiviert" : "deaktiviert");
+		else
+			printf("Fehler! Richtige Anwendung: \"autoupdate <0/1>\"\n");
+	}
 	else if(!strcmp(command, "savedata"))
 		cm_saveData();
+	else if(!strcmp(command, "saveprofile"))
+		cm_profile('w');
+	else if(!strcmp(command, "loadprofile"))
+		cm_profile('q');
+	else if(!strcmp(command, "activateprofile"))
+		cm_profile('p');
 	else if(!strcmp(command, "loadscript"))
 		if(!loadingScript) // prevent recursive script-calling
 			cm_loadScript();
@@ -181,6 +250,16 @@ void handleInput(void)
 		cm_filter();
 	else if(!strcmp(command, "listfilter"))
 		cm_listFilter();
+	else if(!strcmp(command, "gamma"))
+		cm_gamma();
+	else if(!strcmp(command, "listgamma"))
+		cm_listGamma();
+	else if(!strcmp(command, "stats"))
+		cm_stats();
+	else if(!strcmp(command, "stream"))
+		cm_stream();
+	else if(!strcmp(command, "scope"))
+		cm_scope();
 	else if(!strcmp(command, "clearall"))
 	{
 		printf("Setze alle Werte auf null...");
@@ -195,6 +274,7 @@ void handleInput(void)
 		cm_listHysteresis();
 		cm_listStarter();
 		cm_listFilter();
+		cm_listGamma();
 	}
 	else if(!strcmp(command, "plot"))
 		cm_plot();
@@ -204,6 +284,10 @@ void handleInput(void)
 	{
 		printf("Unbekannter Befehl! Um Hilfe zu erhalten, gib \"help\" ein.\n");
 	}
+	if(autoUpdate && se_isPortOpen() && (!strcmp(command, "breakpoint") || !strcmp(command, "dimmer")
+		|| !strcmp(command, "hysteresis") || !strcmp(command, "starter") || !strcmp(command, "filter")
+		|| !strcmp(command, "gamma") || !strcmp(command, "clearall") || !strcmp(command, "loadfile")))
+		cm_update();
 	for(int i=0; i < INPUT_BUFFER; i++)
 		inputBuffer[i] = 0;
 }
@@ -234,7 +318,10 @@ void cm_loadFile(void)
 			{
 				if(fscanf(inputFile, "%c", pkdCache+i) == EOF)
 				{
-					tooShort = 1;
+					if(i < KOMBIDATA_MIN_SIZE)
+						tooShort = 1;
+					for(; i < sizeof(kombiData); i++) // files of older versions don't contain the newer parameters
+						pkdCache[i] = 0;
 					break;
 				}
 			}
@@ -309,41 +396,25 @@ void cm_loadData(void)
 {
 	if(se_isPortOpen())
 	{
+		// one frame with crc, the controller checks it and activates the data on success
 		char cacheBuffer[INPUT_BUFFER];
-		se_put('l');
+		uint16_t crc = cm_crc(0, '1');
+		se_put('c');
+		se_put('1');
 		for(int i=0; i < sizeof(kombiData); i++)
+		{
 			se_put(pkdActive[i]);
+			crc = cm_crc(crc, pkdActive[i]);
+		}
+		se_put(crc >> 8);
+		se_put(crc & 0xFF);
 		se_put('e');
+		sentValid = 0;
 		if(cm_readStatus(cacheBuffer))
 		{
-			printf("Daten erfolgreich vermittelt.\n");
-			printf("Lese vermittelte Daten...\n");
-			time_t beginning = time(NULL);
-			while(difftime(time(NULL), beginning) < SERIAL_READ_TIMEOUT);
-			se_putN("ge",2);
-			if(cm_readAnswer(cacheBuffer, sizeof(kombiData)+2))
-			{
-				if(cacheBuffer[0] != 'd')
-					printf("Fehler! Kombiinstrument sendete unerwartete Antwort.\n");
-				else
-				{
-					int dataCorrect = 1;
-					for(int i=0; i < sizeof(kombiData); i++)
-						if(cacheBuffer[i+1] != pkdActive[i])
-							dataCorrect = 0;
-					if(!dataCorrect)
-						printf("Fehler! Gesendete und empfange Daten sind nicht identisch.\n");
-					else
-					{
-						printf("Vermittelte Daten korrekt. Aktiviere Daten...\n");
-						se_putN("te",2);
-						if(cm_readStatus(cacheBuffer))
-							printf("Daten erfolgreich aktiviert.\n");
-						else
-							printf("Daten konnten nicht aktiviert werden.\n");
-					}
-				}
-			}
+			kdSent = kdActive;
+			sentValid = 1;
+			printf("Daten erfolgreich vermittelt und aktiviert.\n");
 		}
 	}
 	else
@@ -365,6 +436,8 @@ void cm_getData(void)
 			{
 				for(int i=0; i < sizeof(kombiData); i++) //sizeof(kombiData); i++)
 					pkdActive[i] = cacheBuffer[i+1];
+				kdSent = kdActive;
+				sentValid = 1;
 				resetData();
 				printf("Daten erfolgreich empfangen.\n");
 			}
@@ -381,20 +454,177 @@ void cm_saveData(void)
 		printf("Speichere Daten dauerhaft...\n");
 		char cacheBuffer[INPUT_BUFFER];
 		se_putN("se",2);
+		readTimeout = SERIAL_SAVE_TIMEOUT; // the controller answers after the last byte is written
 		if(cm_readStatus(cacheBuffer))
 			printf("Daten erfolgreich gespeichert.\n");
 		else
 			printf("Daten konnten nicht gespeichert werden.\n");
+		readTimeout = SERIAL_READ_TIMEOUT;
 	}
 	else
 		printf("Fehler! Es ist kein Port reserviert.\n");
 }
 
+void cm_profile(char type)
+{
+	int profile;
+	if(sscanf(inputBuffer, "%*s %d", &profile) != 1 || profile < 0 || profile >= NUM_PROFILES)
+		printf("Fehler! Gib eine Profilnummer von 0 bis %d an.\n", NUM_PROFILES-1);
+	else if(se_isPortOpen())
+	{
+		char cacheBuffer[INPUT_BUFFER];
+		se_put(type);
+		se_put('0' + profile);
+		se_put('e');
+		if(type != 'w') // the cache of the controller gets replaced
+			sentValid = 0;
+		if(type == 'w')
+			readTimeout = SERIAL_SAVE_TIMEOUT; // the controller answers after the last byte is written
+		if(cm_readStatus(cacheBuffer))
+		{
+			if(type == 'w')
+				printf("Profil %d erfolgreich gespeichert.\n", profile);
+			else if(type == 'q')
+				printf("Profil %d erfolgreich geladen.\n", profile);
+			else
+				printf("Profil %d erfolgreich aktiviert.\n", profile);
+		}
+		readTimeout = SERIAL_READ_TIMEOUT;
+	}
+	else
+		printf("Fehler! Es ist kein Port reserviert.\n");
+}
+
+void cm_update(void)
+{
+	if(!se_isPortOpen())
+		printf("Fehler! Es ist kein Port reserviert.\n");
+	else if(!sentValid) // the data of the controller is unknown, everything has to be sent
+		cm_loadData();
+	else
+	{
+		char *pkdSent = (char *) &kdSent;
+		int start = -1, end = 0, patches = 0, bytes = 0;
+		for(int i=0; i <= sizeof(kombiData); i++)
+		{
+			if(i < sizeof(kombiData) && pkdActive[i] != pkdSent[i])
+			{
+				if(start < 0)
+					start = i;
+				end = i + 1;
+			}
+			else if(start >= 0 && (i - end >= PATCH_GAP || i == sizeof(kombiData)))
+			{
+				// the last patch activates the data
+				int last = 1;
+				for(int k=i; k < sizeof(kombiData); k++)
+					if(pkdActive[k] != pkdSent[k])
+						last = 0;
+				if(!cm_patch(start, end - start, last))
+				{
+					sentValid = 0;
+					return;
+				}
+				patches++;
+				bytes += end - start;
+				start = -1;
+			}
+		}
+		if(patches)
+			printf("%d geaenderte Bytes in %d Paket(en) uebertragen und aktiviert.\n", bytes, patches);
+		else
+			printf("Keine Aenderungen zu uebertragen.\n");
+	}
+}
+
+int cm_patch(int offset, int length, int activate)
+{
+	char cacheBuffer[INPUT_BUFFER];
+	// the controller accepts up to PATCH_SIZE bytes per patch, only the last part activates the data
+	for(int end = offset + length; offset < end; offset += PATCH_SIZE)
+	{
+		int size = end - offset < PATCH_SIZE ? end - offset : PATCH_SIZE;
+		se_put('x');
+		se_put(activate && offset + size == end ? '1' : '0');
+		se_put(offset);
+		se_put(size);
+		se_putN(pkdActive + offset, size);
+		se_put('e');
+		if(!cm_readStatus(cacheBuffer))
+			return 0;
+		for(int i=offset; i < offset + size; i++)
+			((char *) &kdSent)[i] = pkdActive[i];
+	}
+	return 1;
+}
+
+void cm_baudrate(void)
+{
+	long baudrate;
+	int index = NUM_BAUD;
+	if(sscanf(inputBuffer, "baudrate %ld", &baudrate) == 1)
+		for(index=0; index < NUM_BAUD; index++)
+			if(baudRates[index] == baudrate)
+				break;
+	if(index >= NUM_BAUD)
+	{
+		printf("Fehler! Erlaubte Baudraten:");
+		for(int i=0; i < NUM_BAUD; i++)
+			printf(" %ld", baudRates[i]);
+		printf("\n");
+	}
+	else if(!se_isPortOpen())
+		printf("Fehler! Es ist kein Port reserviert.\n");
+	else if(cm_setBaudrate(index))
+		printf("Baudrate erfolgreich auf %ld umgestellt.\n", baudRates[index]);
+}
+
+int cm_setBaudrate(int index)
+{
+	// the controller answers with the old baudrate and expects the same command with the new one
+	char cacheBuffer[INPUT_BUFFER];
+	char frame[3] = {'b', '0' + index, 'e'};
+	se_putN(frame, 3);
+	if(!cm_readStatus(cacheBuffer))
+		return 0;
+	if(!se_setBaudrate(baudRates[index]))
+	{
+		se_setBaudrate(baudRates[0]); // the controller falls back to the default without confirmation
+		baudIndex = 0;
+		return 0;
+	}
+	clock_t beginning = clock();
+	while(clock() - beginning < CLOCKS_PER_SEC / 100); // give the controller time to switch
+	se_putN(frame, 3);
+	if(!cm_readStatus(cacheBuffer))
+	{
+		printf("Fehler! Keine Bestaetigung, zurueck zu %ld baud/s.\n", baudRates[0]);
+		se_setBaudrate(baudRates[0]);
+		baudIndex = 0;
+		return 0;
+	}
+	baudIndex = index;
+	return 1;
+}
+
+uint16_t cm_crc(uint16_t crc, uint8_t data)
+{
+	crc ^= (uint16_t) data << 8;
+	for(int i=0; i < 8; i++)
+	{
+		if(crc & 0x8000)
+			crc = (crc << 1) ^ 0x1021;
+		else
+			crc <<= 1;
+	}
+	return crc;
+}
+
 int cm_readAnswer(char *buffer, int length)
 {
 	int index = 0;
 	time_t beginning = time(NULL);
-	while(difftime(time(NULL), beginning) < SERIAL_READ_TIMEOUT && index < length)
+	while(difftime(time(NULL), beginning) < readTimeout && index < length)
 		if(se_get(buffer+index))
 			index++;
 	buffer[index] = 0;
@@ -419,6 +649,12 @@ int cm_readStatus(char *buffer)
 			printf("Fehler! Kombiinstrument kennt Befehl nicht.\n");
 		else if(buffer[1] == STATUS_INVALID)
 			printf("Fehler! Befehl wurde falsch vermittelt.\n");
+		else if(buffer[1] == STATUS_BUSY)
+			printf("Fehler! Kombiinstrument speichert gerade, bitte erneut versuchen.\n");
+		else if(buffer[1] == STATUS_EMPTY)
+			printf("Fehler! Das Profil ist nicht gespeichert.\n");
+		else if(buffer[1] == STATUS_CRC)
+			printf("Fehler! Pruefsumme stimmt nicht, Daten wurden verworfen.\n");
 		else if(buffer[1] != STATUS_OK)
 			printf("Fehler! Unbekannter Status.\n");
 		else
@@ -629,18 +865,31 @@ void cm_listStarter(void)
 
 void cm_filter(void)
 {
-	unsigned int filter=0, variables=0;
-	variables = sscanf(inputBuffer, "filter %u", &filter);
-	if(variables == 1)
+	unsigned int filter=0, filterMedian=0, filterEma=0, variables=0;
+	variables = sscanf(inputBuffer, "filter %u %u %u", &filter, &filterMedian, &filterEma);
+	if(variables == 1 || variables == 3)
 	{
+		if(filter > 255) // target variable is uint8_t
+			filter = 255;
 		kdActive.filter = filter;
+		if(variables == 3)
+		{
+			if(filterMedian > 5) // the controller supports a median of max. 5 values
+				filterMedian = 5;
+			if(filterEma > 8)
+				filterEma = 8;
+			kdActive.filterMedian = filterMedian;
+			kdActive.filterEma = filterEma;
+		}
 		printf("Filter-Parameter erfolgreich angepasst.\n");
 	}
 	else
 	{
 		printf("Fehler! Nicht zugelassene Eingabe.\n");
-		printf("-> Richtige Anwendung: \"filter <time>\"\n");
-		printf("-> Drehzahlwechselrate in 100us.\n");
+		printf("-> Richtige Anwendung: \"filter <time> [<median> <ema>]\"\n");
+		printf("-> Drehzahlwechselrate in 100us (0 = aus).\n");
+		printf("-> Median ueber <median> Messwerte (0 = aus, max. 5).\n");
+		printf("-> Gleitender Mittelwert mit Gewichtung 1/2^<ema> (0 = aus, max. 8).\n");
 		printf("-> Alle Parameter werden als Ganzzahlen vorrausgesetzt.\n");
 	}
 }
@@ -648,8 +897,356 @@ void cm_filter(void)
 void cm_listFilter(void)
 {
 	printf("==============[filter]=============\n");
-	printf("time: %uus\n", kdActive.filter * 100);
+	printf("time: %uus median: %u ema: %u\n", kdActive.filter * 100, kdActive.filterMedian, kdActive.filterEma);
+	printf("------------------------------------\n");
+}
+
+void cm_gamma(void)
+{
+	unsigned int gamma=0;
+	if(sscanf(inputBuffer, "gamma %u", &gamma) == 1 && gamma < NUM_GAMMA)
+	{
+		kdActive.gamma = gamma;
+		printf("Helligkeitskorrektur erfolgreich angepasst.\n");
+	}
+	else
+	{
+		printf("Fehler! Nicht zugelassene Eingabe.\n");
+		printf("-> Richtige Anwendung: \"gamma <0/1/2>\"\n");
+		printf("-> 0 = linear, 1 = Gamma 2.2, 2 = CIE 1931 (gleichmaessig empfundene Helligkeit).\n");
+	}
+}
+
+void cm_listGamma(void)
+{
+	char *names[NUM_GAMMA] = {"linear", "Gamma 2.2", "CIE 1931"};
+	printf("==============[gamma]=============\n");
+	if(kdActive.gamma < NUM_GAMMA)
+		printf("gamma: %u (%s)\n", kdActive.gamma, names[kdActive.gamma]);
+	else
+		printf("gamma: %u (ungueltig, linear)\n", kdActive.gamma);
+	printf("------------------------------------\n");
+}
+
+void cm_stats(void)
+{
+	if(se_isPortOpen())
+	{
+		char *names[NUM_IR] = {"Zeitbasis", "Drehzahl", "PWM", "UART RX", "UART TX", "EEPROM"};
+		char cacheBuffer[INPUT_BUFFER];
+		kombiStats stats;
+		se_putN("ie",2);
+		if(!cm_readAnswer(cacheBuffer, sizeof(kombiStats)+2))
+		{
+			if(cacheBuffer[0] == 's' && cacheBuffer[1] == STATUS_UNKNOWN)
+				printf("-> Die Firmware wurde ohne STATS=1 uebersetzt.\n");
+			return;
+		}
+		if(cacheBuffer[0] != 'i')
+		{
+			printf("Fehler! Kombiinstrument sendete unerwartete Antwort.\n");
+			return;
+		}
+		memcpy(&stats, cacheBuffer+1, sizeof(kombiStats));
+		double time = stats.time * 100.0; // us
+		printf("==============[stats]=============\n");
+		printf("Messdauer: %.1fms\n", time / 1000);
+		if(stats.time)
+			printf("CPU-Last: %.1f%% (Schlaf: %.1fms)\n", 100 - stats.sleep * 100.0 / time, stats.sleep / 1000.0);
+		printf("Hauptschleife: %u Durchlaeufe/s\n", stats.loops);
+		printf("Interrupt   Anzahl  Mittel(us)  Max(us)  Last\n");
+		for(int i=0; i < NUM_IR; i++)
+		{
+			interruptStats *is = &stats.interrupts[i];
+			printf("%-10s %7u %11.1f %8u", names[i], is->count, is->count ? (double) is->sum / is->count : 0, is->max);
+			if(stats.time)
+				printf(" %4.1f%%", is->sum * 100.0 / time);
+			printf("%s\n", is->count == 0xFFFF ? " (Zaehler voll)" : "");
+		}
+		printf("UART: %u Ueberlaeufe, %u Rahmenfehler, %u verworfene Zeichen\n", stats.rxOverrun, stats.rxFrame, stats.rxDropped);
+		printf("Verworfene Drehzahlperioden: %u, Wartezeiten beim Senden: %u\n", stats.samplesDropped, stats.txWaits);
+		printf("Rueckfall auf 19200 baud/s: %u\n", stats.baudResets);
+		printf("------------------------------------\n");
+	}
+	else
+		printf("Fehler! Es ist kein Port reserviert.\n");
+}
+
+void cm_stream(void)
+{
+	unsigned int interval=0, duration=0;
+	char pathBuffer[INPUT_BUFFER];
+	if(sscanf(inputBuffer, "stream %u %u %s", &interval, &duration, pathBuffer) != 3 || !interval
+		|| interval > STREAM_MAX_INTERVAL || !duration)
+	{
+		printf("Fehler! Richtige Anwendung: \"stream <ms> <s> <filename>\" (1 bis %u ms)\n", STREAM_MAX_INTERVAL);
+		return;
+	}
+	if(!se_isPortOpen())
+	{
+		printf("Fehler! Es ist kein Port reserviert.\n");
+		return;
+	}
+	FILE *file = fopen(pathBuffer, "wb");
+	if(!file)
+	{
+		printf("Fehler! Datei \"%s\" konnte nicht erstellt werden!\n", pathBuffer);
+		return;
+	}
+	setvbuf(file, NULL, _IOFBF, STREAM_FILE_BUFFER);
+	int length = strlen(pathBuffer);
+	int csv = length > 4 && !strcmp(pathBuffer + length - 4, ".csv");
+	if(csv)
+		fprintf(file, "time_ms;newRpm;rpm;red;green;blue;starterDuty;dimValue;breakActive;dimActive;dimPhase;starter;skipped;rejected;masks\n");
+
+	char cacheBuffer[INPUT_BUFFER];
+	char frame[3] = {'m', interval, 'e'};
+	se_putN(frame, 3);
+	if(!cm_readStatus(cacheBuffer)) // the status is sent before the first frame
+	{
+		fclose(file);
+		return;
+	}
+	printf("Zeichne %u s auf...\n", duration);
+	long frames = 0, skipped = 0, errors = 0;
+	long rejected = 0, masks = 0;
+	uint16_t lastRejected = 0, lastMasks = 0; // the counters of the controller wrap around
+	time_t end = time(NULL) + duration;
+	int answer;
+	while((answer = cm_readStreamAnswer(cacheBuffer, end, &errors)))
+	{
+		if(answer != 'v')
+			continue;
+		kombiTelemetry telemetry;
+		memcpy(&telemetry, cacheBuffer+1, sizeof(kombiTelemetry));
+		if(frames)
+		{
+			rejected += (uint16_t) (telemetry.rejected - lastRejected);
+			masks += (uint16_t) (telemetry.masks - lastMasks);
+		}
+		lastRejected = telemetry.rejected;
+		lastMasks = telemetry.masks;
+		frames++;
+		skipped += telemetry.skipped;
+		if(csv)
+		{
+			fprintf(file, "%.1f;%u;%u", telemetry.time / 10.0, telemetry.newRpm, telemetry.rpm);
+			for(int i=0; i < 4; i++)
+				fprintf(file, ";%.2f", telemetry.dutyCycles[i] * 100.0 / PWM_TICKS);
+			fprintf(file, ";%.3f;%u;%u;%u;%u;%u;%u;%u\n", telemetry.dimValue / 256.0, telemetry.breakActive,
+				telemetry.dimActive, telemetry.dimPhase, telemetry.starter, telemetry.skipped,
+				telemetry.rejected, telemetry.masks);
+		}
+		else
+			fwrite(&telemetry, sizeof(kombiTelemetry), 1, file);
+	}
+
+	// frames queued before the stop command arrive ahead of its status
+	frame[1] = 0;
+	se_putN(frame, 3);
+	end = time(NULL) + readTimeout;
+	while((answer = cm_readStreamAnswer(cacheBuffer, end, &errors)) == 'v');
+	fclose(file);
+	if(answer != 's' || cacheBuffer[1] != STATUS_OK)
+		printf("Fehler! Kombiinstrument hat das Beenden nicht bestaetigt.\n");
+	printf("%ld Frames gespeichert, %ld vom Kombiinstrument uebersprungen, %ld fehlerhafte Zeichen verworfen.\n", frames, skipped, errors);
+	if(skipped)
+		printf("-> Die Baudrate reicht fuer das Intervall nicht aus (siehe \"baudrate\").\n");
+	if(rejected || masks)
+		printf("Drehzahlsignal: %ld Stoerimpulse verworfen, %ld-mal wegen Stoerungen abgeschaltet.\n", rejected, masks);
+}
+
+int cm_readStreamAnswer(char *buffer, time_t end, long *errors)
+{
+	int index = 0, length = 0;
+	while(time(NULL) < end)
+	{
+		if(!se_get(buffer+index))
+			continue;
+		if(index == 0)
+		{
+			if(buffer[0] == 'v')
+				length = sizeof(kombiTelemetry) + 2;
+			else if(buffer[0] == 's')
+				length = 3;
+			else
+			{
+				(*errors)++; // out of sync, skip until the next frame starts
+				continue;
+			}
+		}
+		if(++index == length)
+		{
+			if(buffer[length-1] == 'e')
+				return buffer[0];
+			(*errors)++;
+			index = 0;
+		}
+	}
+	return 0;
+}
+
+void cm_scope(void)
+{
+	unsigned int rpm=0, duration=0;
+	char pathBuffer[INPUT_BUFFER];
+	int arguments = sscanf(inputBuffer, "scope %u %u %s", &rpm, &duration, pathBuffer);
+	if(arguments < 2 || rpm / 100 > 255 || !duration)
+	{
+		printf("Fehler! Richtige Anwendung: \"scope <rpm> <s> [<filename>]\" (0 bis 25500 rpm)\n");
+		return;
+	}
+	if(!se_isPortOpen())
+	{
+		printf("Fehler! Es ist kein Port reserviert.\n");
+		return;
+	}
+	char cacheBuffer[INPUT_BUFFER];
+	char frame[3] = {'o', rpm / 100, 'e'};
+	se_putN(frame, 3);
+	if(!cm_readStatus(cacheBuffer))
+	{
+		if(cacheBuffer[0] == 's' && cacheBuffer[1] == STATUS_UNKNOWN)
+			printf("-> Die Firmware wurde ohne SCOPE=1 uebersetzt.\n");
+		return;
+	}
+	printf("Warte auf Trigger (%u rpm)...\n", rpm / 100 * 100);
+	kombiScope scope;
+	time_t end = time(NULL) + duration;
+	do
+	{
+		clock_t beginning = clock();
+		while(clock() - beginning < CLOCKS_PER_SEC / 1000 * SCOPE_POLL);
+		if(!cm_readScope(&scope))
+			return;
+	}while(scope.state != SCOPE_DONE && time(NULL) < end);
+	if(scope.state != SCOPE_DONE)
+	{
+		printf("Fehler! Aufzeichnung nicht abgeschlossen (%s, %u Perioden).\n",
+			scope.state == SCOPE_ARMED ? "kein Trigger" : "Trigger erreicht", scope.count);
+		return;
+	}
+
+	// the valid periods are at the end of the ring, the rejected ones (glitches) are only counted
+	int first = SCOPE_SIZE - scope.count;
+	int accepted = 0;
+	double sum = 0, squares = 0;
+	unsigned int minimum = SCOPE_PERIOD, maximum = 0;
+	for(int i=first; i < SCOPE_SIZE; i++)
+	{
+		if(scope.periods[i] & SCOPE_REJECTED)
+			continue;
+		accepted++; // at least the trigger
+		double period = (double) scope.periods[i] * scope.unit;
+		sum += period;
+		squares += period * period;
+		if(scope.periods[i] < minimum)
+			minimum = scope.periods[i];
+		if(scope.periods[i] > maximum)
+			maximum = scope.periods[i];
+	}
+	double average = sum / accepted;
+	double deviation = sqrt(squares / accepted - average * average);
+	printf("==============[scope]=============\n");
+	printf("Trigger bei %.1fs, %u Perioden (%u davor, %d verworfen), Aufloesung %uus\n", scope.time / 10000.0,
+		scope.count, scope.trigger - first, scope.count - accepted, scope.unit);
+	printf("Periode: Mittel %.0fus, Min %uus, Max %uus, Streuung %.0fus (%.1f%%)\n", average,
+		minimum * scope.unit, maximum * scope.unit, deviation, 100 * deviation / average);
+	printf("Drehzahl: Mittel %.0f rpm, Min %.0f rpm, Max %.0f rpm\n", RPM_PERIOD / average,
+		RPM_PERIOD / ((double) maximum * scope.unit), RPM_PERIOD / ((double) minimum * scope.unit));
+	for(int i=first; i < SCOPE_SIZE; i++) // compared with the neighbours, so a change of the rpm isn't marked
+	{
+		if(scope.periods[i] & SCOPE_REJECTED)
+			continue;
+		int before = i - 1, after = i + 1; // the nearest accepted periods
+		while(before >= first && (scope.periods[before] & SCOPE_REJECTED))
+			before--;
+		while(after < SCOPE_SIZE && (scope.periods[after] & SCOPE_REJECTED))
+			after++;
+		if(before < first && after >= SCOPE_SIZE)
+			break; // the trigger is the only accepted period
+		if(before < first)
+			before = after;
+		if(after >= SCOPE_SIZE)
+			after = before;
+		double neighbours = scope.periods[before] + scope.periods[after];
+		if(scope.periods[i] > neighbours / 2 * MISFIRE_FACTOR)
+			printf("-> Periode %d ist %.1f-mal so lang wie ihre Nachbarn (Aussetzer?)\n", i - scope.trigger,
+				scope.periods[i] * 2 / neighbours);
+	}
+	cm_plotScope(&scope);
 	printf("------------------------------------\n");
+
+	if(arguments == 3)
+	{
+		FILE *file = fopen(pathBuffer, "w");
+		if(!file)
+		{
+			printf("Fehler! Datei \"%s\" konnte nicht erstellt werden!\n", pathBuffer);
+			return;
+		}
+		fprintf(file, "index;period_us;rpm;rejected\n");
+		for(int i=first; i < SCOPE_SIZE; i++)
+		{
+			unsigned int period = (scope.periods[i] & SCOPE_PERIOD) * scope.unit;
+			fprintf(file, "%d;%u;%.0f;%d\n", i - scope.trigger, period, period ? RPM_PERIOD / period : 0,
+				scope.periods[i] & SCOPE_REJECTED ? 1 : 0);
+		}
+		fclose(file);
+		printf("Aufzeichnung in \"%s\" gespeichert.\n", pathBuffer);
+	}
+}
+
+int cm_readScope(kombiScope *scope)
+{
+	char cacheBuffer[INPUT_BUFFER + sizeof(kombiScope)];
+	se_putN("he",2);
+	if(!cm_readAnswer(cacheBuffer, sizeof(kombiScope)+2))
+		return 0;
+	if(cacheBuffer[0] != 'h')
+	{
+		printf("Fehler! Kombiinstrument sendete unerwartete Antwort.\n");
+		return 0;
+	}
+	memcpy(scope, cacheBuffer+1, sizeof(kombiScope));
+	return 1;
+}
+
+void cm_plotScope(kombiScope *scope)
+{
+	// one column per period, the rows span the rpm range of the accepted periods,
+	// the rejected ones are marked with 'x' below the plot
+	int first = SCOPE_SIZE - scope->count;
+	double rpms[SCOPE_SIZE];
+	double low = 1e9, high = 0;
+	for(int i=first; i < SCOPE_SIZE; i++)
+	{
+		if(scope->periods[i] & SCOPE_REJECTED)
+			continue;
+		rpms[i] = RPM_PERIOD / ((double) scope->periods[i] * scope->unit);
+		if(rpms[i] < low)
+			low = rpms[i];
+		if(rpms[i] > high)
+			high = rpms[i];
+	}
+	if(high - low < 1)
+		high = low + 1;
+	for(int row=SCOPE_ROWS-1; row >= 0; row--)
+	{
+		printf("%6.0f |", low + (high - low) * row / (SCOPE_ROWS - 1));
+		for(int i=first; i < SCOPE_SIZE; i++)
+		{
+			int level = -1;
+			if(!(scope->periods[i] & SCOPE_REJECTED))
+				level = (int) ((rpms[i] - low) / (high - low) * (SCOPE_ROWS - 1) + 0.5);
+			printf("%c", level == row ? '*' : (i == scope->trigger ? ':' : ' '));
+		}
+		printf("\n");
+	}
+	printf("       +");
+	for(int i=first; i < SCOPE_SIZE; i++)
+		printf("%c", i == scope->trigger ? 'T' : (scope->periods[i] & SCOPE_REJECTED ? 'x' : '-'));
+	printf("\n");
 }
 
 void cm_plot(void)
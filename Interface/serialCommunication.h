@@ -41,6 +41,9 @@ int se_openPort(char *port);
 // Closes the communication port.
 int se_closePort(void);
 
+// Sets the baudrate of the opened port (19200 after opening).
+int se_setBaudrate(long baudrate);
+
 // Sends one char to the opened port.
 int se_put(char value);
 
@@ -28,10 +28,32 @@
 #include <fcntl.h>
 #include <string.h>
 #include <dirent.h>
+#include <sys/ioctl.h>
+#include <asm/ioctls.h>
 
 #define COLUMNS 8 // divide portlisting output into columns
 #define PORTBUFFER 100 // to store the port
 
+#ifndef BOTHER
+#define BOTHER 0010000 // arbitrary baudrate in c_ispeed/c_ospeed
+#endif
+#ifndef CBAUD
+#define CBAUD 0010017 // mask of the baudrate bits in c_cflag
+#endif
+
+// termios2 of the kernel, <asm/termbits.h> can't be included together with <termios.h>
+struct termios2
+{
+	tcflag_t c_iflag;
+	tcflag_t c_oflag;
+	tcflag_t c_cflag;
+	tcflag_t c_lflag;
+	cc_t c_line;
+	cc_t c_cc[19];
+	speed_t c_ispeed;
+	speed_t c_ospeed;
+};
+
 struct termios se_tio, se_tioOld;
 int se_tty_fd;
 int se_flags;
@@ -99,6 +121,57 @@ int se_openPort(char *port)
 	return 0;
 }
 
+int se_setBaudrate(long baudrate)
+{
+	if(!se_isPortOpen())
+	{
+		printf("Fehler! Es ist kein Port reserviert.\n");
+		return 0;
+	}
+
+	speed_t speed = 0;
+	if(baudrate == 19200)
+		speed = B19200;
+	else if(baudrate == 38400)
+		speed = B38400;
+	else if(baudrate == 57600)
+		speed = B57600;
+	else if(baudrate == 115200)
+		speed = B115200;
+	else if(baudrate == 230400)
+		speed = B230400;
+	else if(baudrate == 500000)
+		speed = B500000;
+
+	tcdrain(se_tty_fd); // send the remaining data with the old baudrate
+	if(speed)
+	{
+		cfsetospeed(&se_tio, speed);
+		cfsetispeed(&se_tio, speed);
+		tcsetattr(se_tty_fd, TCSANOW, &se_tio);
+	}
+	else // not a standard baudrate, set it directly in the driver
+	{
+		struct termios2 tio2;
+		if(ioctl(se_tty_fd, TCGETS2, &tio2) < 0)
+		{
+			printf("Fehler! Baudrate wird nicht unterstuetzt.\n");
+			return 0;
+		}
+		tio2.c_cflag &= ~CBAUD;
+		tio2.c_cflag |= BOTHER;
+		tio2.c_ispeed = baudrate;
+		tio2.c_ospeed = baudrate;
+		if(ioctl(se_tty_fd, TCSETS2, &tio2) < 0)
+		{
+			printf("Fehler! Baudrate wird nicht unterstuetzt.\n");
+			return 0;
+		}
+	}
+	tcflush(se_tty_fd, TCIFLUSH); // drop anything received during the switch
+	return 1;
+}
+
 int se_closePort(void)
 {
 	if(se_isPortOpen())
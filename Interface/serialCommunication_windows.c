@@ -45,6 +45,12 @@ int se_openPort(char *port)
 	return 0;
 }
 
+int se_setBaudrate(long baudrate)
+{
+	printf("Fehler! Funktion derzeit nicht implementiert.\n");
+	return 0;
+}
+
 int se_closePort(void)
 {
 	printf("Fehler! Funktion derzeit nicht implementiert.\n");